@@ -0,0 +1,190 @@
+/**
+ * @file Arduino.cpp
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief Host Arduino core, every clock reads the simulation's virtual time
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <esp_sntp.h>
+#include <esp_sleep.h>
+#include <sim.h>
+
+HardwareSerial Serial;
+EspClass ESP;
+
+/** Epoch at boot once NTP answered, 2026-01-01 */
+const time_t SIM_EPOCH = 1767225600;
+/** NTP server answers */
+bool sim_ntp_ok = true;
+/** Time was synced */
+bool sim_time_set = false;
+/** Time zone offset, seconds */
+long sim_tz_offset = 0;
+/** configTime() started SNTP, and who to tell when it syncs */
+bool sim_sntp_started = false;
+sntp_sync_time_cb_t sim_sntp_cb = nullptr;
+
+size_t HardwareSerial::print(const char* v)
+{
+    if(quiet) { return strlen(v); }
+    return fputs(v, stdout) >= 0 ? strlen(v) : 0;
+}
+
+size_t HardwareSerial::println(const char* v)
+{
+    return print(v) + print("\n");
+}
+
+size_t HardwareSerial::write(const uint8_t* buf, size_t len)
+{
+    if(quiet) { return len; }
+    return fwrite(buf, 1, len, stdout);
+}
+
+int HardwareSerial::availableForWrite()
+{
+    /** UART TX FIFO */
+    return 128;
+}
+
+/** Registered shutdown handlers */
+shutdown_handler_t shutdown_handlers[5];
+uint8_t shutdown_count = 0;
+
+int esp_register_shutdown_handler(shutdown_handler_t handler)
+{
+    for(uint8_t x = 0; x < shutdown_count; x++)
+    {
+        if(shutdown_handlers[x] == handler) { return -1; }
+    }
+    if(shutdown_count == 5) { return -1; }
+    shutdown_handlers[shutdown_count++] = handler;
+    return 0;
+}
+
+void EspClass::restart()
+{
+    for(uint8_t x = 0; x < shutdown_count; x++) { shutdown_handlers[x](); }
+    sim_restart = true;
+}
+
+uint32_t EspClass::getFreeHeap() { return 200000; }
+uint32_t EspClass::getMinFreeHeap() { return 180000; }
+uint32_t EspClass::getHeapSize() { return 320000; }
+
+unsigned long millis() { return sim_now / 1000; }
+/** 32 bit and wraps after 71 minutes, like the ESP32 core */
+uint32_t micros() { return (uint32_t)sim_now; }
+void delay(unsigned long ms) { sim_advance(ms * 1000ULL); }
+void delayMicroseconds(unsigned int us) { sim_advance(us); }
+void yield() {}
+long random(long max) { return max > 0 ? rand() % max : 0; }
+long random(long min, long max) { return max > min ? min + rand() % (max - min) : min; }
+void pinMode(uint8_t pin, uint8_t mode) {}
+void digitalWrite(uint8_t pin, uint8_t val) {}
+
+void configTime(long gmt_offset, int dst_offset, const char* server1, const char* server2, const char* server3)
+{
+    sim_tz_offset = gmt_offset + dst_offset;
+    sim_sntp_started = true;
+    sim_ntp_poll();
+}
+
+void sntp_set_time_sync_notification_cb(sntp_sync_time_cb_t callback)
+{
+    sim_sntp_cb = callback;
+}
+
+/**
+ * @brief SNTP syncs once it is started and the server answers
+ *
+ */
+void sim_ntp_poll()
+{
+    if(!sim_sntp_started || !sim_ntp_ok || sim_time_set) { return; }
+    sim_time_set = true;
+    if(sim_sntp_cb != nullptr)
+    {
+        struct timeval tv = { time(nullptr), (suseconds_t)(sim_now % 1000000) };
+        sim_sntp_cb(&tv);
+    }
+}
+
+int64_t esp_timer_get_time() { return sim_now - sim_boot_us; }
+
+/**
+ * @brief Epoch with micros, the ESP32 keeps it on the RTC through deep sleep
+ *
+ */
+extern "C" int gettimeofday(struct timeval* tv, void* tz)
+{
+    tv->tv_sec = time(nullptr);
+    tv->tv_usec = sim_now % 1000000;
+    return 0;
+}
+
+/** Deep sleep state */
+bool sim_sleeping = false;
+uint64_t sim_sleep_us = 0;
+bool sim_woke = false;
+uint64_t sim_boot_us = 0;
+
+int esp_sleep_enable_timer_wakeup(uint64_t time_in_us)
+{
+    sim_sleep_us = time_in_us;
+    return 0;
+}
+
+void esp_deep_sleep_start()
+{
+    sim_sleeping = true;
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause()
+{
+    return sim_woke ? ESP_SLEEP_WAKEUP_TIMER : ESP_SLEEP_WAKEUP_UNDEFINED;
+}
+
+/**
+ * @brief Boot again, esp_timer restarts, millis and micros carry on on host
+ *
+ */
+void sim_boot(bool woke)
+{
+    sim_woke = woke;
+    sim_boot_us = sim_now;
+}
+
+/**
+ * @brief Epoch seconds, counts from 0 at boot until NTP set it
+ *
+ */
+extern "C" time_t time(time_t* t)
+{
+    time_t now = sim_now / 1000000 + (sim_time_set ? SIM_EPOCH : 0);
+    if(t != nullptr) { *t = now; }
+    return now;
+}
+
+/**
+ * @brief Local time, waits up to ms for a sync like the ESP32 core does
+ *
+ */
+bool getLocalTime(struct tm* info, uint32_t ms)
+{
+    if(!sim_time_set)
+    {
+        sim_advance(ms * 1000ULL);
+        return false;
+    }
+
+    time_t now = SIM_EPOCH + sim_now / 1000000 + sim_tz_offset;
+    gmtime_r(&now, info);
+    return true;
+}
@@ -0,0 +1,157 @@
+/**
+ * @file Arduino.h
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief Host shim for the parts of the Arduino core the firmware uses
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef __Arduino_H__
+#define __Arduino_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <string>
+
+typedef uint8_t byte;
+
+/** WisBlock IO pins, only used as numbers on host */
+#define WB_IO2 2
+#define WB_IO4 4
+#define WB_IO5 5
+#define WB_IO6 6
+#define OUTPUT 1
+#define HIGH   1
+#define LOW    0
+
+/**
+ * @brief Arduino String on top of std::string
+ *
+ */
+class String
+{
+    public:
+    String() {}
+    String(const char* c) : s(c ? c : "") {}
+    String(const std::string& c) : s(c) {}
+    String(char c) : s(1, c) {}
+    String(int v) : s(std::to_string(v)) {}
+    String(unsigned int v) : s(std::to_string(v)) {}
+    String(long v) : s(std::to_string(v)) {}
+    String(unsigned long v) : s(std::to_string(v)) {}
+    String(long long v) : s(std::to_string(v)) {}
+    String(unsigned long long v) : s(std::to_string(v)) {}
+    String(double v, unsigned int decimals = 2)
+    {
+        char buf[48];
+        snprintf(buf, sizeof(buf), "%.*f", decimals, v);
+        s = buf;
+    }
+
+    const char* c_str() const { return s.c_str(); }
+    unsigned int length() const { return s.size(); }
+    long toInt() const { return atol(s.c_str()); }
+    float toFloat() const { return atof(s.c_str()); }
+    char charAt(unsigned int i) const { return i < s.size() ? s[i] : 0; }
+    char operator[](unsigned int i) const { return charAt(i); }
+    bool startsWith(const String& p) const { return s.compare(0, p.s.size(), p.s) == 0; }
+    int indexOf(char c, unsigned int from = 0) const
+    {
+        size_t i = s.find(c, from);
+        return i == std::string::npos ? -1 : (int)i;
+    }
+    String substring(unsigned int from) const
+    {
+        return from >= s.size() ? String() : String(s.substr(from));
+    }
+    String substring(unsigned int from, unsigned int to) const
+    {
+        if(from >= s.size() || to <= from) { return String(); }
+        return String(s.substr(from, to - from));
+    }
+    void trim()
+    {
+        size_t a = s.find_first_not_of(" \t\r\n");
+        size_t b = s.find_last_not_of(" \t\r\n");
+        s = a == std::string::npos ? "" : s.substr(a, b - a + 1);
+    }
+
+    String& operator+=(const String& o) { s += o.s; return *this; }
+    String& operator+=(const char* o) { s += o; return *this; }
+    String& operator+=(char o) { s += o; return *this; }
+    bool operator==(const String& o) const { return s == o.s; }
+    bool operator==(const char* o) const { return s == o; }
+    bool operator!=(const String& o) const { return s != o.s; }
+    bool operator<(const String& o) const { return s < o.s; }
+
+    friend String operator+(const String& a, const String& b) { return String(a.s + b.s); }
+    friend String operator+(const String& a, const char* b) { return String(a.s + b); }
+    friend String operator+(const char* a, const String& b) { return String(a + b.s); }
+    friend String operator+(const String& a, char b) { return String(a.s + b); }
+
+    private:
+    std::string s;
+};
+
+/**
+ * @brief Serial port, writes to stdout
+ *
+ */
+class HardwareSerial
+{
+    public:
+    void begin(unsigned long baud) {}
+    operator bool() const { return true; }
+    size_t print(const char* v);
+    size_t print(const String& v) { return print(v.c_str()); }
+    size_t println(const char* v);
+    size_t println(const String& v) { return println(v.c_str()); }
+    size_t write(const uint8_t* buf, size_t len);
+    int availableForWrite();
+    void flush() {}
+    /** Drop all output, for benchmarks */
+    bool quiet = false;
+};
+extern HardwareSerial Serial;
+
+/**
+ * @brief ESP32 system calls
+ *
+ */
+class EspClass
+{
+    public:
+    void restart();
+    uint32_t getFreeHeap();
+    uint32_t getMinFreeHeap();
+    uint32_t getHeapSize();
+};
+extern EspClass ESP;
+
+/** ESP-IDF shutdown handlers, ESP.restart() runs them */
+typedef void (*shutdown_handler_t)(void);
+int esp_register_shutdown_handler(shutdown_handler_t handler);
+
+unsigned long millis();
+uint32_t micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+long random(long max);
+long random(long min, long max);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+
+/** ESP32 time sync */
+void configTime(long gmt_offset, int dst_offset, const char* server1, const char* server2 = nullptr, const char* server3 = nullptr);
+bool getLocalTime(struct tm* info, uint32_t ms = 5000);
+
+#endif
@@ -0,0 +1,133 @@
+/**
+ * @file Preferences.cpp
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <Preferences.h>
+#include <map>
+#include <vector>
+
+/** All namespaces, "namespace/key" to raw bytes */
+std::map<std::string, std::vector<uint8_t>> nvs;
+/** Loaded from file yet */
+bool nvs_loaded = false;
+
+const char* Preferences::file = nullptr;
+
+/**
+ * @brief Load every key from file
+ * One key per line, name then hex bytes
+ *
+ */
+void nvs_load()
+{
+    nvs_loaded = true;
+    if(Preferences::file == nullptr) { return; }
+
+    FILE* f = fopen(Preferences::file, "r");
+    if(f == nullptr) { return; }
+
+    char name[64];
+    char hex[8192];
+    while(fscanf(f, "%63s %8191s", name, hex) == 2)
+    {
+        std::vector<uint8_t> value;
+        for(size_t x = 0; hex[x] != 0 && hex[x + 1] != 0 && hex[0] != '-'; x += 2)
+        {
+            unsigned int b;
+            sscanf(hex + x, "%2x", &b);
+            value.push_back(b);
+        }
+        nvs[name] = value;
+    }
+    fclose(f);
+}
+
+/**
+ * @brief Save every key to file
+ *
+ */
+void nvs_save()
+{
+    if(Preferences::file == nullptr) { return; }
+
+    FILE* f = fopen(Preferences::file, "w");
+    if(f == nullptr) { return; }
+
+    for(auto& kv : nvs)
+    {
+        fprintf(f, "%s ", kv.first.c_str());
+        if(kv.second.empty()) { fprintf(f, "-"); }
+        for(uint8_t b : kv.second) { fprintf(f, "%02x", b); }
+        fprintf(f, "\n");
+    }
+    fclose(f);
+}
+
+bool Preferences::begin(const char* ns, bool read_only)
+{
+    if(!nvs_loaded) { nvs_load(); }
+    name = ns;
+    return true;
+}
+
+bool Preferences::isKey(const char* key)
+{
+    return nvs.count(name + "/" + key) > 0;
+}
+
+bool Preferences::remove(const char* key)
+{
+    bool found = nvs.erase(name + "/" + key) > 0;
+    nvs_save();
+    return found;
+}
+
+bool Preferences::clear()
+{
+    std::string prefix = name + "/";
+    for(auto it = nvs.begin(); it != nvs.end();)
+    {
+        it = it->first.compare(0, prefix.size(), prefix) == 0 ? nvs.erase(it) : std::next(it);
+    }
+    nvs_save();
+    return true;
+}
+
+size_t Preferences::getBytesLength(const char* key)
+{
+    auto it = nvs.find(name + "/" + key);
+    return it == nvs.end() ? 0 : it->second.size();
+}
+
+size_t Preferences::getBytes(const char* key, void* buf, size_t len)
+{
+    auto it = nvs.find(name + "/" + key);
+    if(it == nvs.end() || it->second.size() > len) { return 0; }
+
+    memcpy(buf, it->second.data(), it->second.size());
+    return it->second.size();
+}
+
+size_t Preferences::put(const char* key, const void* value, size_t len)
+{
+    const uint8_t* bytes = (const uint8_t*)value;
+    nvs[name + "/" + key] = std::vector<uint8_t>(bytes, bytes + len);
+    nvs_save();
+    return len;
+}
+
+bool Preferences::get(const char* key, void* value, size_t len)
+{
+    auto it = nvs.find(name + "/" + key);
+    if(it == nvs.end() || it->second.size() != len) { return false; }
+
+    memcpy(value, it->second.data(), len);
+    return true;
+}
@@ -0,0 +1,56 @@
+/**
+ * @file Preferences.h
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief Host shim for ESP32 Preferences, kept in memory
+ * and optionally saved to a file so warm boots can be tested
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef __Preferences_H__
+#define __Preferences_H__
+
+#include <Arduino.h>
+
+/**
+ * @brief Preferences instance
+ *
+ */
+class Preferences
+{
+    public:
+    bool begin(const char* name, bool read_only = false);
+    void end() {}
+
+    bool isKey(const char* key);
+    bool remove(const char* key);
+    bool clear();
+
+    size_t putBool(const char* key, bool value) { return put(key, &value, sizeof(value)); }
+    size_t putUChar(const char* key, uint8_t value) { return put(key, &value, sizeof(value)); }
+    size_t putInt(const char* key, int32_t value) { return put(key, &value, sizeof(value)); }
+    size_t putUInt(const char* key, uint32_t value) { return put(key, &value, sizeof(value)); }
+    size_t putULong64(const char* key, uint64_t value) { return put(key, &value, sizeof(value)); }
+    size_t putBytes(const char* key, const void* value, size_t len) { return put(key, value, len); }
+
+    bool getBool(const char* key, bool value = false) { get(key, &value, sizeof(value)); return value; }
+    uint8_t getUChar(const char* key, uint8_t value = 0) { get(key, &value, sizeof(value)); return value; }
+    int32_t getInt(const char* key, int32_t value = 0) { get(key, &value, sizeof(value)); return value; }
+    uint32_t getUInt(const char* key, uint32_t value = 0) { get(key, &value, sizeof(value)); return value; }
+    uint64_t getULong64(const char* key, uint64_t value = 0) { get(key, &value, sizeof(value)); return value; }
+    size_t getBytesLength(const char* key);
+    size_t getBytes(const char* key, void* buf, size_t len);
+
+    /** File to load from and save to, nullptr for memory only */
+    static const char* file;
+
+    private:
+    size_t put(const char* key, const void* value, size_t len);
+    bool get(const char* key, void* value, size_t len);
+    std::string name;
+};
+
+#endif
@@ -0,0 +1,93 @@
+/**
+ * @file PubSubClient.cpp
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <PubSubClient.h>
+
+/** Downlink handler, for sim_downlink() */
+void (*sim_callback)(char*, uint8_t*, unsigned int) = nullptr;
+/** Last topic subscribed to */
+std::string sim_subscribed;
+/** Publish log, --mqtt */
+FILE* sim_mqtt_log = nullptr;
+
+PubSubClient& PubSubClient::setCallback(void (*cb)(char*, uint8_t*, unsigned int))
+{
+    sim_callback = cb;
+    return *this;
+}
+
+bool PubSubClient::setBufferSize(uint16_t size)
+{
+    buffer_size = size;
+    return true;
+}
+
+bool PubSubClient::connect(const char* id, const char* user, const char* pass)
+{
+    /** TLS and CONNECT round trips, a broker that's down runs TCP, TLS and CONNACK to their timeout */
+    sim_advance(sim_broker_up && sim_wifi_up ? 400000 : 3000000ULL * socket_timeout);
+    session = sim_broker_up && sim_wifi_up;
+    return session;
+}
+
+bool PubSubClient::subscribe(const char* topic)
+{
+    sim_subscribed = topic;
+    return connected();
+}
+
+bool PubSubClient::connected()
+{
+    if(!sim_broker_up || !sim_wifi_up) { session = false; }
+    return session;
+}
+
+bool PubSubClient::publish(const char* topic, const char* payload)
+{
+    return publish(topic, (const uint8_t*)payload, strlen(payload));
+}
+
+bool PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int len)
+{
+    /** Fixed header, topic length, topic, payload */
+    size_t packet = 5 + strlen(topic) + len;
+    if(!connected() || packet > buffer_size)
+    {
+        sim_stats.publish_dropped++;
+        return false;
+    }
+
+    sim_stats.publishes++;
+    sim_stats.publish_bytes += strlen(topic) + len;
+    sim_stats.payload_bytes += len;
+    if(sim_mqtt_log != nullptr)
+    {
+        fprintf(sim_mqtt_log, "%s ", topic);
+        for(unsigned int x = 0; x < len; x++) { fprintf(sim_mqtt_log, "%02x", payload[x]); }
+        fprintf(sim_mqtt_log, "\n");
+    }
+    return true;
+}
+
+/**
+ * @brief Deliver a message as if the broker sent it
+ *
+ * @param topic nullptr for the subscribed config topic
+ * @param payload
+ */
+void sim_downlink(const char* topic, const char* payload)
+{
+    if(sim_callback == nullptr) { return; }
+
+    static char topic_buf[128];
+    strncpy(topic_buf, topic ? topic : sim_subscribed.c_str(), sizeof(topic_buf) - 1);
+    sim_callback(topic_buf, (uint8_t*)payload, strlen(payload));
+}
@@ -0,0 +1,55 @@
+/**
+ * @file PubSubClient.h
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief Host shim for PubSubClient, counts what would be published
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef __PubSubClient_H__
+#define __PubSubClient_H__
+
+#include <Arduino.h>
+#include <WiFiClientSecure.h>
+#include <sim.h>
+
+#define MQTT_CALLBACK_SIGNATURE void (*callback)(char*, uint8_t*, unsigned int)
+
+/**
+ * @brief MQTT client
+ *
+ */
+class PubSubClient
+{
+    public:
+    PubSubClient(WiFiClientSecure& client) {}
+    PubSubClient& setServer(const char* domain, uint16_t port) { return *this; }
+    PubSubClient& setKeepAlive(uint16_t keep_alive) { return *this; }
+    PubSubClient& setSocketTimeout(uint16_t timeout)
+    {
+        socket_timeout = timeout;
+        return *this;
+    }
+    PubSubClient& setCallback(MQTT_CALLBACK_SIGNATURE);
+    bool setBufferSize(uint16_t size);
+    uint16_t getBufferSize() { return buffer_size; }
+
+    bool connect(const char* id, const char* user, const char* pass);
+    void disconnect() { session = false; }
+    bool connected();
+    int state() { return connected() ? 0 : -2; }
+    bool loop() { return connected(); }
+    bool subscribe(const char* topic);
+    bool publish(const char* topic, const char* payload);
+    bool publish(const char* topic, const uint8_t* payload, unsigned int len);
+
+    private:
+    bool session = false;
+    uint16_t buffer_size = 256;
+    uint16_t socket_timeout = 15;
+};
+
+#endif
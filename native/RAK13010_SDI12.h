@@ -0,0 +1,39 @@
+/**
+ * @file RAK13010_SDI12.h
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief Host shim for RAK_SDI12, backed by the simulated bus
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef __RAK13010_SDI12_H__
+#define __RAK13010_SDI12_H__
+
+#include <Arduino.h>
+#include <sim.h>
+
+/**
+ * @brief RAK SDI-12 Lib
+ * sendCommand() takes as long as the real line would
+ *
+ */
+class RAK_SDI12
+{
+    public:
+    RAK_SDI12(int8_t rx_pin, int8_t tx_pin, int8_t oe_pin) {}
+    void begin() {}
+    void end() {}
+    void forceHold() {}
+    void forceListen() {}
+    void sendCommand(const char* cmd, int8_t extra_wake = 0) { sim_bus_send(cmd); }
+    void sendCommand(const String& cmd, int8_t extra_wake = 0) { sim_bus_send(cmd.c_str()); }
+    int available() { return sim_bus_available(); }
+    int read() { return sim_bus_read(); }
+    int peek() { return sim_bus_peek(); }
+    void clearBuffer() { sim_bus_clear(); }
+};
+
+#endif
@@ -0,0 +1,73 @@
+/**
+ * @file SD.cpp
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <SD.h>
+#include <sys/stat.h>
+
+SDClass SD;
+const char* SDClass::root = "sd";
+
+/**
+ * @brief Host path for a card path
+ *
+ */
+std::string sd_path(const char* path)
+{
+    return std::string(SDClass::root) + path;
+}
+
+size_t File::size()
+{
+    if(!f) { return 0; }
+    long pos = ftell(f);
+    fseek(f, 0, SEEK_END);
+    long end = ftell(f);
+    fseek(f, pos, SEEK_SET);
+    return end;
+}
+
+bool SDClass::begin()
+{
+    if(root == nullptr) { return false; }
+    ::mkdir(root, 0755);
+    return true;
+}
+
+File SDClass::open(const char* path, const char* mode)
+{
+    if(root == nullptr) { return File(); }
+    /** Card files are read and written in binary, and append can still seek */
+    const char* host_mode = "rb";
+    if(strcmp(mode, FILE_WRITE) == 0) { host_mode = "w+b"; }
+    if(strcmp(mode, FILE_APPEND) == 0) { host_mode = "a+b"; }
+    return File(fopen(sd_path(path).c_str(), host_mode), path);
+}
+
+bool SDClass::exists(const char* path)
+{
+    struct stat st;
+    return root != nullptr && stat(sd_path(path).c_str(), &st) == 0;
+}
+
+bool SDClass::remove(const char* path)
+{
+    return root != nullptr && ::remove(sd_path(path).c_str()) == 0;
+}
+
+bool SDClass::rename(const char* from, const char* to)
+{
+    return root != nullptr && ::rename(sd_path(from).c_str(), sd_path(to).c_str()) == 0;
+}
+
+bool SDClass::mkdir(const char* path)
+{
+    return root != nullptr && ::mkdir(sd_path(path).c_str(), 0755) == 0;
+}
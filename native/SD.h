@@ -0,0 +1,74 @@
+/**
+ * @file SD.h
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief Host shim for the ESP32 SD lib, card root is a host folder
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef __SD_H__
+#define __SD_H__
+
+#include <Arduino.h>
+
+#define FILE_READ   "r"
+#define FILE_WRITE  "w"
+#define FILE_APPEND "a"
+
+/**
+ * @brief Open file on the card
+ *
+ */
+class File
+{
+    public:
+    File() {}
+    File(FILE* f, const char* path) : f(f), path(path) {}
+    operator bool() const { return f != nullptr; }
+
+    size_t print(const char* v) { return f ? fputs(v, f) >= 0 ? strlen(v) : 0 : 0; }
+    size_t print(const String& v) { return print(v.c_str()); }
+    size_t println(const char* v) { return print(v) + print("\n"); }
+    size_t println(const String& v) { return println(v.c_str()); }
+    size_t write(const uint8_t* buf, size_t len) { return f ? fwrite(buf, 1, len, f) : 0; }
+    size_t write(uint8_t b) { return write(&b, 1); }
+    int read() { return f ? fgetc(f) : -1; }
+    size_t read(uint8_t* buf, size_t len) { return f ? fread(buf, 1, len, f) : 0; }
+    int available() { return f ? size() - position() : 0; }
+    bool seek(uint32_t pos) { return f && fseek(f, pos, SEEK_SET) == 0; }
+    size_t position() { return f ? ftell(f) : 0; }
+    size_t size();
+    void flush() { if(f) { fflush(f); } }
+    void close() { if(f) { fclose(f); } f = nullptr; }
+    const char* name() const { return path.c_str(); }
+
+    private:
+    FILE* f = nullptr;
+    std::string path;
+};
+
+/**
+ * @brief SD card
+ *
+ */
+class SDClass
+{
+    public:
+    bool begin();
+    File open(const char* path, const char* mode = FILE_READ);
+    bool exists(const char* path);
+    bool remove(const char* path);
+    bool rename(const char* from, const char* to);
+    bool mkdir(const char* path);
+    uint64_t totalBytes() { return 1ULL << 32; }
+    uint64_t usedBytes() { return 0; }
+
+    /** Host folder holding the card, nullptr for no card */
+    static const char* root;
+};
+extern SDClass SD;
+
+#endif
@@ -0,0 +1,17 @@
+/**
+ * @file SPI.h
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief Host shim, nothing needed
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef __SPI_H__
+#define __SPI_H__
+
+#include <Arduino.h>
+
+#endif
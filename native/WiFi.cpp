@@ -0,0 +1,41 @@
+/**
+ * @file WiFi.cpp
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <WiFi.h>
+
+WiFiClass WiFi;
+
+/** Association takes this long after begin(), micros */
+#define SIM_WIFI_JOIN_US 1500000
+
+/** Associated from, 0 before begin() */
+uint64_t sim_wifi_joined = 0;
+
+void WiFiClass::begin(const char* ssid, const char* pass)
+{
+    sim_wifi_joined = sim_now + SIM_WIFI_JOIN_US;
+}
+
+void WiFiClass::disconnect(bool wifi_off, bool erase)
+{
+    sim_wifi_joined = 0;
+}
+
+/**
+ * @brief Connected once the join time passed, reconnects on its own
+ * after the access point comes back like the ESP32 does
+ *
+ */
+uint8_t WiFiClass::status()
+{
+    bool joined = sim_wifi_joined != 0 && sim_now >= sim_wifi_joined;
+    return sim_wifi_up && joined ? WL_CONNECTED : WL_DISCONNECTED;
+}
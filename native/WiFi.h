@@ -0,0 +1,53 @@
+/**
+ * @file WiFi.h
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief Host shim for ESP32 WiFi, link state set by the simulation
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef __WiFi_H__
+#define __WiFi_H__
+
+#include <Arduino.h>
+#include <sim.h>
+
+#define WL_IDLE_STATUS    0
+#define WL_CONNECTED      3
+#define WL_CONNECT_FAILED 4
+#define WL_DISCONNECTED   6
+
+#define WIFI_OFF 0
+#define WIFI_STA 1
+
+/**
+ * @brief IP address
+ *
+ */
+class IPAddress
+{
+    public:
+    String toString() const { return "127.0.0.1"; }
+};
+
+/**
+ * @brief WiFi station
+ *
+ */
+class WiFiClass
+{
+    public:
+    void setHostname(const char* name) {}
+    void mode(uint8_t mode) {}
+    void begin(const char* ssid, const char* pass);
+    void disconnect(bool wifi_off = false, bool erase = false);
+    bool setAutoReconnect(bool value) { return true; }
+    uint8_t status();
+    IPAddress localIP() { return IPAddress(); }
+};
+extern WiFiClass WiFi;
+
+#endif
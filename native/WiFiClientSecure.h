@@ -0,0 +1,30 @@
+/**
+ * @file WiFiClientSecure.h
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief Host shim for the TLS client
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef __WiFiClientSecure_H__
+#define __WiFiClientSecure_H__
+
+#include <Arduino.h>
+
+/**
+ * @brief SSL/TLS WiFi client
+ *
+ */
+class WiFiClientSecure
+{
+    public:
+    void setTimeout(uint32_t seconds) {}
+    void setCACert(const char* cert) {}
+    void setHandshakeTimeout(unsigned long seconds) {}
+    void stop() {}
+};
+
+#endif
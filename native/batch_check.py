@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+"""
+Check batch messages from a sim run, layout in README CMD 8
+
+    batch_check.py mqtt.txt [readings]     sim --mqtt output, [SIM] readings count
+
+Every .../batch payload has to parse as JSON with no repeated keys, and
+every reading has to show up once with its own time: no address and time
+pair repeats across .../batch and .../queued messages. Given the readings
+count the run printed, the entries have to add up to it.
+"""
+
+import json
+import sys
+
+
+def strict(pairs):
+    """object_pairs_hook, a repeated key is an error rather than last one wins"""
+    keys = [k for k, _ in pairs]
+    dupes = {k for k in keys if keys.count(k) > 1}
+    if dupes:
+        raise ValueError("repeated keys %s" % sorted(dupes))
+    return dict(pairs)
+
+
+def entries(topic, payload):
+    """(address, epoch) for each reading in a message, [] for other topics"""
+    if topic.endswith("/batch"):
+        message = json.loads(payload, object_pairs_hook=strict)
+        return [(d["a"], d["t"]) for d in message["d"]]
+    if topic.endswith("/queued"):
+        addr = topic.split("/")[-2]
+        return [(addr, int(payload.split(",")[0]))]
+    return []
+
+
+def main():
+    if len(sys.argv) < 2:
+        print(__doc__.strip())
+        return 2
+
+    seen = {}
+    errors = 0
+    with open(sys.argv[1]) as f:
+        for line, text in enumerate(f, 1):
+            parts = text.split()
+            if len(parts) != 2:
+                continue
+            topic, payload = parts[0], bytes.fromhex(parts[1]).decode()
+            try:
+                found = entries(topic, payload)
+            except (ValueError, KeyError) as err:
+                print("line %d: %s: %s" % (line, topic, err))
+                errors += 1
+                continue
+            for key in found:
+                if key in seen:
+                    print("line %d: %s at %d also on line %d" % (line, key[0], key[1], seen[key]))
+                    errors += 1
+                seen[key] = line
+
+    print("readings: %d" % len(seen))
+    if len(sys.argv) > 2 and len(seen) != int(sys.argv[2]):
+        print("expected %s readings" % sys.argv[2])
+        errors += 1
+    return 1 if errors else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,53 @@
+#!/usr/bin/env python3
+"""
+Compare two benchmark JSON lines, i.e. from two commits
+
+    program --sensors 10 --cycles 5 --json > new.json
+    native/bench_compare.py old.json new.json
+
+Takes the last line starting with { from each file, so device
+serial captures work too. Prints every number that changed.
+"""
+
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        lines = [line for line in f if line.startswith("{")]
+    if not lines:
+        sys.exit("no JSON line in " + path)
+    return json.loads(lines[-1])
+
+
+def flatten(data, prefix=""):
+    out = {}
+    for key, value in data.items():
+        name = prefix + key
+        if isinstance(value, dict):
+            out.update(flatten(value, name + "."))
+        elif isinstance(value, (int, float)) and not isinstance(value, bool):
+            out[name] = value
+    return out
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit("usage: bench_compare.py OLD NEW")
+    old = flatten(load(sys.argv[1]))
+    new = flatten(load(sys.argv[2]))
+    for name in sorted(set(old) | set(new)):
+        a = old.get(name)
+        b = new.get(name)
+        if a == b:
+            continue
+        if a is None or b is None:
+            print("%-44s %14s -> %s" % (name, a, b))
+            continue
+        change = "" if a == 0 else " (%+.1f%%)" % (100.0 * (b - a) / a)
+        print("%-44s %14g -> %g%s" % (name, a, b, change))
+
+
+if __name__ == "__main__":
+    main()
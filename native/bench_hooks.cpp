@@ -0,0 +1,83 @@
+/**
+ * @file bench_hooks.cpp
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief Host clock and heap counting for bench.cpp
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <Arduino.h>
+#include <bench.h>
+#include <chrono>
+#include <new>
+
+/** Heap allocations through operator new */
+uint32_t heap_allocs;
+/** Bytes asked for through operator new */
+uint64_t heap_bytes;
+
+/**
+ * @brief Host wall clock, micros() is virtual time here
+ *
+ * @return uint32_t
+ */
+uint32_t bench_us()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Heap allocations so far
+ *
+ * @param allocs
+ * @param bytes
+ * @return true Counts are real
+ */
+bool bench_heap(uint32_t& allocs, uint64_t& bytes)
+{
+    allocs = heap_allocs;
+    bytes = heap_bytes;
+    return true;
+}
+
+/**
+ * @brief Count every allocation, String and std containers all land here
+ *
+ */
+void* operator new(size_t size)
+{
+    heap_allocs++;
+    heap_bytes += size;
+    void* p = malloc(size ? size : 1);
+    if(p == nullptr) { throw std::bad_alloc(); }
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t size) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, size_t size) noexcept
+{
+    free(p);
+}
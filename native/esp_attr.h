@@ -0,0 +1,18 @@
+/**
+ * @file esp_attr.h
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief Host shim for ESP-IDF memory placement attributes
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef __esp_attr_H__
+#define __esp_attr_H__
+
+/** RTC slow memory, kept through deep sleep, host globals are kept anyway */
+#define RTC_DATA_ATTR
+
+#endif
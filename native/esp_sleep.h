@@ -0,0 +1,29 @@
+/**
+ * @file esp_sleep.h
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief Host shim for ESP-IDF deep sleep, the simulation skips the time asleep
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef __esp_sleep_H__
+#define __esp_sleep_H__
+
+#include <Arduino.h>
+
+/** Why the chip booted, only the causes the firmware checks */
+typedef enum
+{
+    ESP_SLEEP_WAKEUP_UNDEFINED = 0,
+    ESP_SLEEP_WAKEUP_TIMER = 4
+} esp_sleep_wakeup_cause_t;
+
+int esp_sleep_enable_timer_wakeup(uint64_t time_in_us);
+/** Returns on host, the simulation wakes the firmware through setup() after loop() */
+void esp_deep_sleep_start();
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause();
+
+#endif
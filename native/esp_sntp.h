@@ -0,0 +1,22 @@
+/**
+ * @file esp_sntp.h
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief Host shim for the ESP-IDF SNTP sync notification
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef __esp_sntp_H__
+#define __esp_sntp_H__
+
+#include <Arduino.h>
+#include <sys/time.h>
+
+/** Called each time SNTP sets the time */
+typedef void (*sntp_sync_time_cb_t)(struct timeval* tv);
+void sntp_set_time_sync_notification_cb(sntp_sync_time_cb_t callback);
+
+#endif
@@ -0,0 +1,20 @@
+/**
+ * @file esp_timer.h
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief Host shim for the ESP-IDF high resolution timer
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef __esp_timer_H__
+#define __esp_timer_H__
+
+#include <Arduino.h>
+
+/** Micros since boot, 64 bit so it never wraps */
+int64_t esp_timer_get_time();
+
+#endif
@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+"""
+Decode binary SD log records, layout in src/logger.h
+
+    log_decode.py 20260101_0.bin [...]     log files off the card
+    log_decode.py --hex log.txt            lines ending in a hex payload, i.e sim --mqtt
+                                           output, only binary /log messages are used
+    --long                                 a row per value: epoch,address,index,value
+                                           one schema for every sensor, loads straight
+                                           into pandas/Parquet
+
+Prints CSV: epoch,address,value,value,...
+Records that fail their CRC are skipped and counted on stderr,
+decoding picks up again at the next record that checks out.
+Records that had values left out are noted on stderr.
+"""
+
+import struct
+import sys
+
+LOG_REC_SYNC = 0xA5
+LOG_REC_HEADER = 8
+LOG_REC_TRUNC = 0x01
+
+
+def crc16(data):
+    """CRC-16/ARC, as SDI-12 uses it"""
+    crc = 0
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0xA001 if crc & 1 else crc >> 1
+    return crc
+
+
+def decode(data, bad):
+    """Yield (epoch, address, [values]) per good record, counts bad bytes in bad[0]"""
+    pos = 0
+    while pos + LOG_REC_HEADER <= len(data):
+        if data[pos] != LOG_REC_SYNC:
+            pos += 1
+            bad[0] += 1
+            continue
+        count = data[pos + 2]
+        end = pos + LOG_REC_HEADER + count * 4
+        if end + 2 > len(data) or crc16(data[pos:end]) != struct.unpack_from("<H", data, end)[0]:
+            pos += 1
+            bad[0] += 1
+            continue
+        epoch = struct.unpack_from("<I", data, pos + 4)[0]
+        if data[pos + 3] & LOG_REC_TRUNC:
+            print("%d,%s truncated" % (epoch, chr(data[pos + 1])), file=sys.stderr)
+        values = struct.unpack_from("<%df" % count, data, pos + LOG_REC_HEADER)
+        yield epoch, chr(data[pos + 1]), values
+        pos = end + 2
+    bad[0] += len(data) - pos
+
+
+def main():
+    args = sys.argv[1:]
+    long_form = "--long" in args
+    args = [a for a in args if a != "--long"]
+    if not args:
+        sys.exit(__doc__)
+
+    blobs = []
+    if args[0] == "--hex":
+        for path in args[1:]:
+            data = b""
+            with open(path) as f:
+                for line in f:
+                    fields = line.split()
+                    if len(fields) < 2 or not fields[0].endswith("/log"):
+                        continue
+                    payload = bytes.fromhex(fields[-1])
+                    if payload and payload[0] == LOG_REC_SYNC:
+                        data += payload
+            blobs.append(data)
+    else:
+        for path in args:
+            with open(path, "rb") as f:
+                blobs.append(f.read())
+
+    bad = [0]
+    if long_form:
+        print("epoch,address,index,value")
+    for data in blobs:
+        for epoch, addr, values in decode(data, bad):
+            # float32 holds about 7 significant digits
+            if long_form:
+                for x, value in enumerate(values):
+                    print("%d,%s,%d,%.7g" % (epoch, addr, x, value))
+            else:
+                print(",".join([str(epoch), addr] + ["%.7g" % v for v in values]))
+    if bad[0]:
+        print("skipped %d bytes that were not good records" % bad[0], file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+"""
+Decode packed reading messages, layout in src/packed.h
+
+    packed_decode.py message.bin [...]     raw payloads, one message per file
+    packed_decode.py --hex log.txt         lines ending in a hex payload, i.e sim --mqtt
+                                           output, lines without a packed topic are skipped
+
+Prints CSV: epoch,address,value,value,...
+Values print with the decimals the sensor sent them with.
+Readings that had values left out are noted on stderr.
+"""
+
+import struct
+import sys
+
+PACKED_VERSION = 1
+PACKED_COUNT = 0x1F
+PACKED_TRUNC = 0x40
+PACKED_F32 = 0x80
+
+
+def varint(data, pos):
+    """zigzag LEB128 at pos, returns value and next pos"""
+    value = 0
+    shift = 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            break
+    return (value >> 1) ^ -(value & 1), pos
+
+
+def decode(data):
+    """Yield (epoch, address, [(value, decimals)]) per reading"""
+    if len(data) < 6 or data[0] != PACKED_VERSION:
+        raise ValueError("not a version %d packed message" % PACKED_VERSION)
+    epoch, count = struct.unpack_from("<IB", data, 1)
+    pos = 6
+    for _ in range(count):
+        addr = chr(data[pos])
+        delta, pos = varint(data, pos + 1)
+        epoch = (epoch + delta) & 0xFFFFFFFF
+        flags = data[pos]
+        pos += 1
+        values = flags & PACKED_COUNT
+        if flags & PACKED_TRUNC:
+            print("%d,%s truncated" % (epoch, addr), file=sys.stderr)
+        decimals = []
+        for x in range(0, values, 2):
+            decimals.append(data[pos] & 0x0F)
+            decimals.append(data[pos] >> 4)
+            pos += 1
+        fmt, size = ("<f", 4) if flags & PACKED_F32 else ("<e", 2)
+        out = []
+        for x in range(values):
+            out.append((struct.unpack_from(fmt, data, pos)[0], decimals[x]))
+            pos += size
+        yield epoch, addr, out
+
+
+def print_message(data):
+    for epoch, addr, values in decode(data):
+        text = ["%.*f" % (decimals, value) for value, decimals in values]
+        print(",".join([str(epoch), addr] + text))
+
+
+def main():
+    args = sys.argv[1:]
+    if not args:
+        sys.exit(__doc__)
+    if args[0] == "--hex":
+        for path in args[1:]:
+            with open(path) as f:
+                for line in f:
+                    fields = line.split()
+                    if not fields or (len(fields) > 1 and not fields[0].endswith("/packed")):
+                        continue
+                    print_message(bytes.fromhex(fields[-1]))
+    else:
+        for path in args:
+            with open(path, "rb") as f:
+                print_message(f.read())
+
+
+if __name__ == "__main__":
+    main()
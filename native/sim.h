@@ -0,0 +1,120 @@
+/**
+ * @file sim.h
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief Host simulation controls, virtual clock and SDI-12 bus
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef __sim_H__
+#define __sim_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Simulated SDI-12 sensor
+ *
+ */
+struct sim_sensor_t
+{
+    /** SDI-12 address */
+    char addr = '0';
+    /** Seconds reported in the measure reply */
+    uint16_t ttt = 1;
+    /** Actual measurement time, ms */
+    uint32_t ready_ms = 800;
+    /** Send a<CR><LF> when an [a]M! measurement is done */
+    bool service_request = true;
+    /** Values as sent, i.e +1.23 */
+    std::vector<std::string> values;
+    /** [a]I! reply after the address */
+    std::string info = "13SIMULATESENSOR001SIM00001";
+    /** Chance to ignore a command, 0-1 */
+    float drop = 0;
+    /** Chance to garble a reply, 0-1 */
+    float garble = 0;
+    /** Answers [a]R[0-9]! with its values */
+    bool continuous = false;
+    /** Reply start after the command, micros, spec max 15000 */
+    uint32_t latency_us = 8000;
+
+    /** Measurement done at, sim micros */
+    uint64_t ready_at = 0;
+    /** Measurement was [a]C! */
+    bool concurrent = false;
+    /** Measurement asked for CRC checked data, [a]MC!/[a]CC! */
+    bool crc = false;
+    /** Has data to send */
+    bool has_data = false;
+};
+
+/**
+ * @brief Simulation counters
+ *
+ */
+struct sim_stats_t
+{
+    /** Commands sent on the bus */
+    uint32_t commands = 0;
+    /** Time the bus carried a command or reply, micros */
+    uint64_t bus_busy_us = 0;
+    /** Messages published */
+    uint32_t publishes = 0;
+    /** Topic plus payload bytes published */
+    uint64_t publish_bytes = 0;
+    /** Payload bytes published */
+    uint64_t payload_bytes = 0;
+    /** Publishes refused while the broker was down */
+    uint32_t publish_dropped = 0;
+    /** Time in deep sleep, and wakes */
+    uint64_t asleep_us = 0;
+    uint32_t wakes = 0;
+    /** Wake to the first bus command, summed over wakes, micros */
+    uint64_t wake_cmd_us = 0;
+};
+
+/** Virtual clock, micros since boot */
+extern uint64_t sim_now;
+/** WiFi association up */
+extern bool sim_wifi_up;
+/** MQTT broker reachable */
+extern bool sim_broker_up;
+/** ESP.restart() was called */
+extern bool sim_restart;
+/** esp_deep_sleep_start() was called, for how long */
+extern bool sim_sleeping;
+extern uint64_t sim_sleep_us;
+/** Booted from a deep sleep timer */
+extern bool sim_woke;
+/** sim_now at the last boot, esp_timer counts from here */
+extern uint64_t sim_boot_us;
+/** Counters */
+extern sim_stats_t sim_stats;
+/** Write every publish here as topic and hex payload, nullptr for none */
+extern FILE* sim_mqtt_log;
+/** Simulated sensors on the bus */
+extern std::vector<sim_sensor_t> sim_sensors;
+
+void sim_advance(uint64_t us);
+void sim_seed(uint32_t seed);
+bool sim_load(const char* path);
+void sim_add_sensors(uint8_t count);
+void sim_events();
+void sim_ntp_poll();
+void sim_boot(bool woke);
+void sim_downlink(const char* topic, const char* payload);
+void sim_pref(const char* type, const char* key, const char* value);
+
+/** RAK_SDI12 backend */
+void sim_bus_send(const char* cmd);
+int sim_bus_available();
+int sim_bus_read();
+int sim_bus_peek();
+void sim_bus_clear();
+
+#endif
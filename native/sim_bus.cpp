@@ -0,0 +1,468 @@
+/**
+ * @file sim_bus.cpp
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief Simulated SDI-12 bus, sensors and scenario scripts
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <sim.h>
+#include <crc16.h>
+#include <deque>
+#include <algorithm>
+#include <random>
+
+/** One character at 1200 baud 7E1, micros */
+#define SIM_CHAR_US 8333
+/** Wake break plus marking before a command, micros */
+#define SIM_BREAK_US 20333
+
+uint64_t sim_now = 0;
+bool sim_wifi_up = true;
+bool sim_broker_up = true;
+bool sim_restart = false;
+sim_stats_t sim_stats;
+std::vector<sim_sensor_t> sim_sensors;
+
+/**
+ * @brief Character on its way to the recorder
+ *
+ */
+struct sim_char_t
+{
+    /** Fully received at, sim micros */
+    uint64_t at;
+    char c;
+};
+
+/**
+ * @brief Scripted event
+ *
+ */
+struct sim_event_t
+{
+    /** Fire at, sim millis */
+    uint64_t at;
+    std::string action;
+    std::string arg;
+};
+
+/** Characters sensors have sent or will send */
+std::deque<sim_char_t> rx;
+/** Scripted events, sorted by time */
+std::vector<sim_event_t> events;
+/** Next event to fire */
+size_t next_event = 0;
+/** Randomness for dropouts and garbling */
+std::mt19937 rng(1);
+
+extern bool sim_ntp_ok;
+
+/**
+ * @brief Move the virtual clock forward
+ *
+ * @param us
+ */
+void sim_advance(uint64_t us)
+{
+    sim_now += us;
+}
+
+/**
+ * @brief Seed dropouts and garbling, runs repeat with the same seed
+ *
+ * @param seed
+ */
+void sim_seed(uint32_t seed)
+{
+    rng.seed(seed);
+}
+
+/**
+ * @brief Roll for a probability
+ *
+ * @param p 0-1
+ */
+bool chance(float p)
+{
+    return p > 0 && std::uniform_real_distribution<float>(0, 1)(rng) < p;
+}
+
+/**
+ * @brief Queue a reply line to start at a time
+ *
+ * @param at sim micros the first character starts
+ * @param line without CR/LF
+ */
+void send_line(uint64_t at, const std::string& line)
+{
+    std::string full = line + "\r\n";
+    for(char c : full)
+    {
+        at += SIM_CHAR_US;
+        rx.push_back({ at, c });
+    }
+    sim_stats.bus_busy_us += full.size() * SIM_CHAR_US;
+    std::sort(rx.begin(), rx.end(), [](const sim_char_t& a, const sim_char_t& b) { return a.at < b.at; });
+}
+
+/**
+ * @brief Values for D command n, split the way a sensor would
+ * 35 characters per D after [a]M!, 75 after [a]C! and per R
+ *
+ * @param sensor
+ * @param n
+ * @param limit
+ */
+std::string data_chunk(const sim_sensor_t& sensor, uint8_t n, size_t limit)
+{
+    std::string chunk;
+    uint8_t d = 0;
+    for(const std::string& value : sensor.values)
+    {
+        if(chunk.size() + value.size() > limit)
+        {
+            if(d++ == n) { return chunk; }
+            chunk.clear();
+        }
+        chunk += value;
+    }
+    return d == n ? chunk : "";
+}
+
+/**
+ * @brief Append the SDI-12 CRC, 0x40 | 6 bits each, high bits first
+ *
+ * @param reply
+ */
+void crc_append(std::string& reply)
+{
+    uint16_t crc = crc16((const uint8_t*)reply.data(), reply.size());
+    reply += (char)(0x40 | (crc >> 12));
+    reply += (char)(0x40 | ((crc >> 6) & 0x3F));
+    reply += (char)(0x40 | (crc & 0x3F));
+}
+
+/**
+ * @brief Sensor reply to a command addressed to it
+ *
+ * @param sensor
+ * @param cmd everything after the address
+ * @param end sim micros the command finished
+ * @return std::string reply, empty for none
+ */
+std::string sensor_reply(sim_sensor_t& sensor, const char* cmd, uint64_t end)
+{
+    std::string addr(1, sensor.addr);
+    char ttt[4];
+    snprintf(ttt, sizeof(ttt), "%03u", (unsigned)(sensor.ttt % 1000));
+
+    if(strcmp(cmd, "!") == 0) { return addr; }
+    if(strcmp(cmd, "I!") == 0) { return addr + sensor.info; }
+    if(cmd[0] == 'A' && cmd[1] != 0 && cmd[2] == '!')
+    {
+        sensor.addr = cmd[1];
+        return std::string(1, sensor.addr);
+    }
+
+    if((cmd[0] == 'M' || cmd[0] == 'C') && (strcmp(cmd + 1, "!") == 0 || strcmp(cmd + 1, "C!") == 0))
+    {
+        sensor.concurrent = cmd[0] == 'C';
+        sensor.crc = cmd[1] == 'C';
+        sensor.ready_at = end + sensor.ready_ms * 1000ULL;
+        sensor.has_data = true;
+        char nn[4];
+        snprintf(nn, sizeof(nn), sensor.concurrent ? "%02u" : "%u", (unsigned)sensor.values.size());
+        return addr + ttt + nn;
+    }
+
+    if(cmd[0] == 'D' && cmd[1] >= '0' && cmd[1] <= '9' && cmd[2] == '!')
+    {
+        std::string reply = addr;
+        if(sensor.has_data && sim_now >= sensor.ready_at)
+        {
+            reply += data_chunk(sensor, cmd[1] - '0', sensor.concurrent ? 75 : 35);
+        }
+        if(sensor.crc) { crc_append(reply); }
+        return reply;
+    }
+
+    /** Continuous reads, [a]R[0-9]! or [a]RC[0-9]! */
+    bool crc = cmd[0] == 'R' && cmd[1] == 'C';
+    const char* n = cmd + (crc ? 2 : 1);
+    if(cmd[0] == 'R' && n[0] >= '0' && n[0] <= '9' && n[1] == '!' && n[2] == 0)
+    {
+        std::string reply = addr;
+        if(sensor.continuous) { reply += data_chunk(sensor, n[0] - '0', 75); }
+        if(crc) { crc_append(reply); }
+        return reply;
+    }
+
+    return "";
+}
+
+/**
+ * @brief Clock a command onto the bus and queue sensor replies
+ * Blocks for as long as the real line would
+ *
+ * @param cmd
+ */
+void sim_bus_send(const char* cmd)
+{
+    uint64_t took = SIM_BREAK_US + strlen(cmd) * SIM_CHAR_US;
+    /** First command since a wake */
+    static uint64_t counted_boot = 0;
+    if(sim_woke && counted_boot != sim_boot_us)
+    {
+        sim_stats.wake_cmd_us += sim_now - sim_boot_us;
+        counted_boot = sim_boot_us;
+    }
+    sim_advance(took);
+    sim_stats.bus_busy_us += took;
+    sim_stats.commands++;
+
+    std::vector<std::pair<sim_sensor_t*, std::string>> replies;
+    for(sim_sensor_t& sensor : sim_sensors)
+    {
+        if(cmd[0] != '?' && cmd[0] != sensor.addr) { continue; }
+        if(chance(sensor.drop)) { continue; }
+
+        std::string reply = sensor_reply(sensor, cmd + 1, sim_now);
+        if(reply.empty()) { continue; }
+        if(chance(sensor.garble))
+        {
+            reply[std::uniform_int_distribution<size_t>(0, reply.size() - 1)(rng)] = '#';
+        }
+        replies.push_back({ &sensor, reply });
+    }
+    if(replies.empty()) { return; }
+
+    /** Sensors talking over each other, only matching characters survive */
+    std::string line = replies[0].second;
+    for(size_t x = 1; x < replies.size(); x++)
+    {
+        const std::string& other = replies[x].second;
+        line.resize(std::max(line.size(), other.size()), '#');
+        for(size_t y = 0; y < line.size(); y++)
+        {
+            if(y >= other.size() || other[y] != line[y]) { line[y] = '#'; }
+        }
+    }
+
+    uint64_t start = sim_now + replies[0].first->latency_us;
+    send_line(start, line);
+
+    /** Service request once an [a]M! measurement is done */
+    sim_sensor_t& sensor = *replies[0].first;
+    if(replies.size() == 1 && cmd[1] == 'M' && sensor.service_request && sensor.ttt > 0)
+    {
+        uint64_t at = std::max(sensor.ready_at, start + (line.size() + 2) * SIM_CHAR_US);
+        send_line(at, std::string(1, sensor.addr));
+    }
+}
+
+int sim_bus_available()
+{
+    int count = 0;
+    for(const sim_char_t& c : rx)
+    {
+        if(c.at > sim_now) { break; }
+        count++;
+    }
+    return count;
+}
+
+int sim_bus_read()
+{
+    if(rx.empty() || rx.front().at > sim_now) { return -1; }
+
+    char c = rx.front().c;
+    rx.pop_front();
+    return c;
+}
+
+int sim_bus_peek()
+{
+    if(rx.empty() || rx.front().at > sim_now) { return -1; }
+    return rx.front().c;
+}
+
+/**
+ * @brief Drop characters already received
+ * Characters still on the wire keep coming
+ *
+ */
+void sim_bus_clear()
+{
+    while(!rx.empty() && rx.front().at <= sim_now)
+    {
+        rx.pop_front();
+    }
+}
+
+/**
+ * @brief Add default sensors at 0, 1, 2...
+ * Every third sensor is slower, so cycles are not all the same
+ *
+ * @param count
+ */
+void sim_add_sensors(uint8_t count)
+{
+    static const char addrs[] = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    for(int x = 0; x < count && x < 62; x++)
+    {
+        sim_sensor_t sensor;
+        sensor.addr = addrs[x];
+        sensor.ttt = x % 3 == 2 ? 3 : 2;
+        sensor.ready_ms = x % 3 == 2 ? 2400 : 1100;
+        sensor.values = { "+21.37", "-0.512", "+1013.2", "+45" };
+        char info[40];
+        snprintf(info, sizeof(info), "13SIMULATESENSOR001SIM%05d", x);
+        sensor.info = info;
+        sim_sensors.push_back(sensor);
+    }
+}
+
+/**
+ * @brief Set a flash value before the firmware boots
+ *
+ * @param type u8, u32, i32, u64 or bool
+ * @param key in SDI12, or namespace/key for another namespace
+ * @param value
+ */
+void sim_pref(const char* type, const char* key, const char* value)
+{
+    Preferences prefs;
+    const char* slash = strchr(key, '/');
+    prefs.begin(slash != nullptr ? std::string(key, slash - key).c_str() : "SDI12", false);
+    if(slash != nullptr) { key = slash + 1; }
+    if(strcmp(type, "u8") == 0) { prefs.putUChar(key, strtoul(value, nullptr, 10)); }
+    if(strcmp(type, "u32") == 0) { prefs.putUInt(key, strtoul(value, nullptr, 10)); }
+    if(strcmp(type, "i32") == 0) { prefs.putInt(key, strtol(value, nullptr, 10)); }
+    if(strcmp(type, "u64") == 0) { prefs.putULong64(key, strtoull(value, nullptr, 10)); }
+    if(strcmp(type, "bool") == 0) { prefs.putBool(key, strcmp(value, "1") == 0 || strcmp(value, "true") == 0); }
+}
+
+/**
+ * @brief Parse one sensor line, key=value pairs
+ *
+ * @param args
+ */
+void parse_sensor(char* args)
+{
+    sim_sensor_t sensor;
+    for(char* tok = strtok(args, " \t"); tok != nullptr; tok = strtok(nullptr, " \t"))
+    {
+        char* eq = strchr(tok, '=');
+        if(eq == nullptr) { continue; }
+        *eq = 0;
+        const char* key = tok;
+        const char* val = eq + 1;
+
+        if(strcmp(key, "addr") == 0) { sensor.addr = val[0]; }
+        if(strcmp(key, "ttt") == 0) { sensor.ttt = atoi(val); }
+        if(strcmp(key, "ready") == 0) { sensor.ready_ms = atoi(val); }
+        if(strcmp(key, "sr") == 0) { sensor.service_request = atoi(val) != 0; }
+        if(strcmp(key, "info") == 0) { sensor.info = val; }
+        if(strcmp(key, "drop") == 0) { sensor.drop = atof(val); }
+        if(strcmp(key, "garble") == 0) { sensor.garble = atof(val); }
+        if(strcmp(key, "latency") == 0) { sensor.latency_us = atoi(val); }
+        if(strcmp(key, "cont") == 0) { sensor.continuous = atoi(val) != 0; }
+        if(strcmp(key, "values") == 0)
+        {
+            /** Split +1.2-3.4 at each sign */
+            sensor.values.clear();
+            for(const char* c = val; *c != 0;)
+            {
+                const char* end = c + 1;
+                while(*end != 0 && *end != '+' && *end != '-') { end++; }
+                sensor.values.push_back(std::string(c, end));
+                c = end;
+            }
+        }
+    }
+    sim_sensors.push_back(sensor);
+}
+
+/**
+ * @brief Load a scenario script
+ *
+ * seed 42
+ * sensors 20
+ * sensor addr=0 ttt=2 ready=1500 sr=1 values=+1.2-3.4 drop=0.01 garble=0.01 cont=1
+ * pref u64 period 30000000
+ * pref u32 SDI12sensors/r12345 0
+ * at 60000 broker down
+ * at 5000 downlink 1+30
+ *
+ * @param path
+ * @return true loaded
+ */
+bool sim_load(const char* path)
+{
+    FILE* f = fopen(path, "r");
+    if(f == nullptr) { return false; }
+
+    char line[512];
+    while(fgets(line, sizeof(line), f))
+    {
+        line[strcspn(line, "\r\n")] = 0;
+        char* cmd = strtok(line, " \t");
+        if(cmd == nullptr || cmd[0] == '#') { continue; }
+        char* rest = strtok(nullptr, "");
+        if(rest == nullptr) { rest = (char*)""; }
+
+        if(strcmp(cmd, "seed") == 0) { sim_seed(atoi(rest)); }
+        if(strcmp(cmd, "sensors") == 0) { sim_add_sensors(atoi(rest)); }
+        if(strcmp(cmd, "sensor") == 0) { parse_sensor(rest); }
+        if(strcmp(cmd, "pref") == 0)
+        {
+            char type[8], key[32], value[32];
+            if(sscanf(rest, "%7s %31s %31s", type, key, value) == 3) { sim_pref(type, key, value); }
+        }
+        if(strcmp(cmd, "at") == 0)
+        {
+            sim_event_t event;
+            char action[16];
+            int used = 0;
+            if(sscanf(rest, "%llu %15s %n", (unsigned long long*)&event.at, action, &used) < 2) { continue; }
+            event.action = action;
+            event.arg = rest + used;
+            events.push_back(event);
+        }
+    }
+    fclose(f);
+
+    std::stable_sort(events.begin(), events.end(), [](const sim_event_t& a, const sim_event_t& b) { return a.at < b.at; });
+    return true;
+}
+
+/**
+ * @brief Fire scripted events that are due
+ *
+ */
+void sim_events()
+{
+    while(next_event < events.size() && events[next_event].at <= sim_now / 1000)
+    {
+        const sim_event_t& event = events[next_event++];
+        bool up = event.arg == "up";
+        if(event.action == "broker") { sim_broker_up = up; }
+        if(event.action == "wifi") { sim_wifi_up = up; }
+        if(event.action == "ntp")
+        {
+            sim_ntp_ok = up;
+            sim_ntp_poll();
+        }
+        if(event.action == "downlink") { sim_downlink(nullptr, event.arg.c_str()); }
+        if(!Serial.quiet)
+        {
+            printf("[SIM] %llu ms: %s %s\n", (unsigned long long)event.at, event.action.c_str(), event.arg.c_str());
+        }
+    }
+}
@@ -0,0 +1,190 @@
+/**
+ * @file sim_main.cpp
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief Host entry point, runs setup() and loop() against the simulated bus
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <SD.h>
+#include <sdi.h>
+#include <MQTT.h>
+#include <bench.h>
+#include <sim.h>
+#include <chrono>
+
+/** Firmware entry points */
+void setup();
+void loop();
+
+/** Firmware MQTT client, main.cpp */
+extern MQTT mqtt_lib;
+
+/**
+ * @brief Host wall clock, micros
+ *
+ */
+uint64_t host_us()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Print usage
+ *
+ */
+void usage(const char* name)
+{
+    printf("usage: %s [scenario] [--cycles N] [--sensors N] [--loop-us N] [--max-s N]\n", name);
+    printf("          [--nvs FILE] [--sd DIR] [--no-sd] [--quiet] [--json] [--parse-iter N]\n");
+    printf("          [--mqtt FILE]\n");
+}
+
+int main(int argc, char** argv)
+{
+    const char* scenario = nullptr;
+    uint32_t cycles = 3;
+    uint32_t sensors = 0;
+    /** Virtual time one loop() pass costs */
+    uint32_t loop_us = 200;
+    /** Stop after this much virtual time */
+    uint64_t max_s = 3600;
+    /** Print one JSON line instead of the summary */
+    bool json = false;
+    /** Parse benchmark passes, 0 to skip */
+    uint32_t parse_iter = BENCH_PARSE_ITER;
+
+    for(int x = 1; x < argc; x++)
+    {
+        const char* arg = argv[x];
+        const char* val = x + 1 < argc ? argv[x + 1] : "";
+        if(strcmp(arg, "--cycles") == 0) { cycles = atoi(val); x++; }
+        else if(strcmp(arg, "--sensors") == 0) { sensors = atoi(val); x++; }
+        else if(strcmp(arg, "--loop-us") == 0) { loop_us = atoi(val); x++; }
+        else if(strcmp(arg, "--max-s") == 0) { max_s = atoi(val); x++; }
+        else if(strcmp(arg, "--nvs") == 0) { Preferences::file = val; x++; }
+        else if(strcmp(arg, "--sd") == 0) { SDClass::root = val; x++; }
+        else if(strcmp(arg, "--no-sd") == 0) { SDClass::root = nullptr; }
+        else if(strcmp(arg, "--quiet") == 0) { Serial.quiet = true; }
+        else if(strcmp(arg, "--json") == 0) { json = true; Serial.quiet = true; }
+        else if(strcmp(arg, "--parse-iter") == 0) { parse_iter = atoi(val); x++; }
+        else if(strcmp(arg, "--mqtt") == 0) { sim_mqtt_log = fopen(val, "w"); x++; }
+        else if(arg[0] == '-') { usage(argv[0]); return 1; }
+        else { scenario = arg; }
+    }
+
+    if(scenario != nullptr && !sim_load(scenario))
+    {
+        printf("Could not load %s\n", scenario);
+        return 1;
+    }
+    if(sensors > 0) { sim_add_sensors(sensors); }
+
+    /** Events at 0 ms hold from boot, i.e ntp down */
+    sim_events();
+    setup();
+    uint64_t boot_done = sim_now;
+    bench_start();
+
+    uint64_t first_reading = 0;
+    uint32_t last_cycles = 0;
+    uint32_t cycle_min = UINT32_MAX;
+    uint32_t cycle_max = 0;
+    uint64_t cycle_sum = 0;
+    /** Time between cycle starts, shows a cycle held up */
+    uint32_t last_start = 0;
+    uint32_t gap_min = UINT32_MAX;
+    uint32_t gap_max = 0;
+    uint64_t loops = 0;
+    uint64_t host_max = 0;
+    uint64_t host_start = host_us();
+
+    while(sdi_cycles < cycles && sim_now < max_s * 1000000ULL)
+    {
+        sim_events();
+
+        uint64_t start = host_us();
+        loop();
+        uint64_t took = host_us() - start;
+        if(took > host_max) { host_max = took; }
+        loops++;
+        sim_advance(loop_us);
+        bench_loop(took);
+
+        if(first_reading == 0 && sim_stats.publishes > 0) { first_reading = sim_now; }
+        if(sdi_cycles != last_cycles)
+        {
+            last_cycles = sdi_cycles;
+            if(cycle_ms < cycle_min) { cycle_min = cycle_ms; }
+            if(cycle_ms > cycle_max) { cycle_max = cycle_ms; }
+            cycle_sum += cycle_ms;
+            if(last_cycles > 1)
+            {
+                gap_min = std::min(gap_min, cycle_start - last_start);
+                gap_max = std::max(gap_max, cycle_start - last_start);
+            }
+            last_start = cycle_start;
+        }
+        if(sim_restart)
+        {
+            sim_restart = false;
+            sim_boot(false);
+            setup();
+        }
+        if(sim_sleeping)
+        {
+            /** Nothing runs asleep, skip straight to the wake */
+            sim_sleeping = false;
+            sim_advance(sim_sleep_us);
+            sim_stats.asleep_us += sim_sleep_us;
+            sim_stats.wakes++;
+            sim_boot(true);
+            setup();
+        }
+    }
+
+    uint64_t host_total = host_us() - host_start;
+    /** The run stops as the last cycle ends, publish what it left in the batch */
+    mqtt_lib.mqtt_flush();
+    if(json)
+    {
+        /** The sim knows the exact bus time, replies included */
+        bench_cycle_t cycle = bench_result();
+        cycle.bus_busy_us = sim_stats.bus_busy_us;
+        cycle.elapsed_us = sim_now;
+        cycle.first_reading_ms = first_reading / 1000;
+        bench_parse_t legacy, current;
+        if(parse_iter > 0) { bench_parse(parse_iter, legacy, current); }
+        static char out[BENCH_JSON];
+        bench_json(&cycle, parse_iter > 0 ? &legacy : nullptr, &current, out, sizeof(out));
+        printf("%s\n", out);
+        return 0;
+    }
+    printf("\n[SIM] sensors: %u, cycles: %u, virtual time: %.3f s\n", (unsigned)sim_sensors.size(), sdi_cycles, sim_now / 1e6);
+    printf("[SIM] setup: %.3f s, first reading: %.3f s\n", boot_done / 1e6, first_reading / 1e6);
+    if(sdi_cycles > 0)
+    {
+        printf("[SIM] cycle ms min/avg/max: %u/%llu/%u\n", cycle_min, (unsigned long long)(cycle_sum / sdi_cycles), cycle_max);
+    }
+    if(gap_max > 0)
+    {
+        printf("[SIM] cycle start to start ms min/max: %u/%u\n", gap_min, gap_max);
+    }
+    printf("[SIM] bus commands: %u, bus busy: %.1f%%\n", sim_stats.commands, sim_now ? 100.0 * sim_stats.bus_busy_us / sim_now : 0);
+    printf("[SIM] publishes: %u, bytes: %llu, dropped: %u\n", sim_stats.publishes, (unsigned long long)sim_stats.publish_bytes, sim_stats.publish_dropped);
+    printf("[SIM] readings: %lu\n", (unsigned long)sdi_readings);
+    if(sim_stats.wakes > 0)
+    {
+        printf("[SIM] wakes: %u, asleep: %.1f%%, wake to first command ms avg: %.1f\n", sim_stats.wakes,
+            100.0 * sim_stats.asleep_us / sim_now, sim_stats.wake_cmd_us / 1e3 / sim_stats.wakes);
+    }
+    printf("[SIM] loops: %llu, host loop us avg/max: %.2f/%llu\n", (unsigned long long)loops, loops ? (double)host_total / loops : 0, (unsigned long long)host_max);
+
+    return 0;
+}
@@ -15,196 +15,556 @@
 #include <WiFiClientSecure.h>
 #include <PubSubClient.h>
 #include <mqtt_config.h>
+#include <store.h>
+#include <logger.h>
+#include <packed.h>
+#include <metrics.h>
+#include <debug.h>
 #include <vector>
 #include <sstream>
 
+/** Readings held for one batch, a sensor may have more than one per cycle */
+#define MQTT_BATCH_MAX 62
+/** Batch payload buffer, the PubSubClient buffer is raised to fit it */
+#define MQTT_BATCH_LEN 4096
+/** PubSubClient buffer outside batch mode, fits a metrics report */
+#define MQTT_BUFFER (METRICS_JSON + 64 + MQTT_OVERHEAD)
+/** Queued readings one packed message holds */
+#define MQTT_PACK_MAX 32
+/** PubSubClient fixed header and topic length bytes */
+#define MQTT_OVERHEAD 7
+/** Most log bytes one range message carries */
+#define MQTT_LOG_CHUNK 1024
+/** Time WiFi gets to associate before trying again, ms */
+#define WIFI_JOIN_MS 15000
+/** Reconnect backoff, doubles per failure up to the max, ms */
+#define BACKOFF_MIN_MS 2000
+#define BACKOFF_MAX_MS 300000
+/** Bound on one blocking broker connect, TCP, TLS and CONNACK each, seconds */
+#define MQTT_CONNECT_S 10
+/** Blocking stages of a broker connect, TCP, TLS and CONNACK */
+#define MQTT_CONNECT_STAGES 3
+/** Time the last packets get to leave before WiFi goes off for deep sleep, ms */
+#define MQTT_SLEEP_MS 100
+/** Downlink fields, missing ones read as empty */
+#define DOWNLINK_FIELDS 5
+
 /** SSL/TLS WiFi client */
 WiFiClientSecure secure_client;
 /** MQTT client */
 PubSubClient mqtt_client(secure_client);
 /** Use CSV or individual readings */
 bool CSV = true;
-/** Give up on trying to connect */
-bool give_up = false;
-/** Retry time for WiFi/MQTT */
-uint64_t connect_time;
+/** Publish a whole cycle as one message */
+bool BATCH = false;
+/** Publish packed binary instead of text */
+bool PACKED = false;
+/** Readings held for the batch message */
+reading_t batch_readings[MQTT_BATCH_MAX];
+/** Readings in the batch */
+uint8_t batch_count;
+/** No broker session */
+bool offline = true;
+/** WiFi association state */
+uint8_t wifi_state;
+/** When the current WiFi join times out, or the next one starts, millis */
+uint32_t wifi_deadline;
+/** Current WiFi backoff, ms */
+uint32_t wifi_backoff = BACKOFF_MIN_MS;
+/** Next broker connect attempt, millis */
+uint32_t broker_retry;
+/** Current broker backoff, ms */
+uint32_t broker_backoff = BACKOFF_MIN_MS;
+/** Broker connect attempts, and how long the last took, ms */
+uint32_t broker_attempts;
+uint32_t broker_connect_ms;
+/** When the broker session came up, millis */
+uint32_t broker_since;
+/** Topic and payload bytes published */
+uint64_t publish_bytes;
+/** Last metrics report, millis */
+uint32_t metrics_last;
+
+/** WiFi association states */
+enum wifi_state_t : uint8_t { WIFI_DOWN, WIFI_JOINING, WIFI_UP };
 
 /** Forward declaration */
-void wifi_connect();
-String parse_data(String data);
-void mqtt_connect();
+void wifi_step();
+void broker_step(uint32_t window_ms);
+uint32_t backoff_next(uint32_t& backoff);
 void mqtt_downlink(char* topic, byte* message, unsigned int length);
-void MQTT_LOG(String chan, String data);
 void parse_config(String data);
+bool parse_u32(const std::string& text, uint32_t& value);
+bool parse_i32(const std::string& text, int32_t& value);
+bool same_word(const std::string& text, const char* word);
+bool parse_bool(const std::string& text, bool& value);
+bool publish_reading(const reading_t& reading, bool queued);
+uint8_t publish_batch(uint8_t first);
+uint8_t publish_packed(const reading_t* readings, uint8_t count);
+void batch_flush();
+void publish_range();
+void mqtt_buffer();
+bool mqtt_send(const char* topic, const uint8_t* payload, size_t len);
 
 /**
- * @brief Connect to WiFi and setup MQTT
+ * @brief Setup MQTT and start joining WiFi
+ * Connecting happens in mqtt_loop(), nothing here waits on the network
  * 
  */
 void MQTT::mqtt_setup()
 {
-    wifi_connect();
+    WiFi.setHostname("SDI-12_data_logger");
+    WiFi.mode(WIFI_STA);
+    secure_client.setTimeout(MQTT_CONNECT_S);
+    secure_client.setHandshakeTimeout(MQTT_CONNECT_S);
+    secure_client.setCACert(server_root_ca);
     mqtt_client.setServer(MQTT_SERVER, MQTT_PORT);
     mqtt_client.setKeepAlive(KEEP_ALIVE);
-    mqtt_client.setSocketTimeout(KEEP_ALIVE);
+    mqtt_client.setSocketTimeout(MQTT_CONNECT_S);
     mqtt_client.setCallback(mqtt_downlink);
-    connect_time = 3600000000;
+    mqtt_buffer();
+    wifi_state = WIFI_DOWN;
+    wifi_deadline = millis();
+    broker_retry = millis();
+    metrics_last = millis();
+    metrics_reset();
+    wifi_step();
 }
 
 /**
  * @brief MQTT Loop
+ * Keep WiFi and the broker session up, with backoff between attempts
+ * 
+ * @param window_ms Time the SDI-12 bus can spare a broker connect, which blocks
+ */
+void MQTT::mqtt_loop(uint32_t window_ms)
+{
+    wifi_step();
+    broker_step(window_ms);
+    offline = !mqtt_client.connected();
+}
+
+/**
+ * @brief Publish reading to MQTT
+ * Held for mqtt_flush() in batch mode
+ * Queued if the broker can't take it, or older readings are still queued
  * 
+ * @param reading 
  */
-void MQTT::mqtt_loop()
+void MQTT::mqtt_publish(const reading_t& reading)
 {
-    /** Always check MQTT connection */
-    if(!give_up)
+    if(BATCH)
     {
-        if(!mqtt_client.connected()) { mqtt_connect(); }
-        mqtt_client.loop();
-    } else {
-        static uint32_t last_time;
-        if ((micros() - last_time) >= connect_time)
+        if(batch_count == MQTT_BATCH_MAX) { batch_flush(); }
+        batch_readings[batch_count++] = reading;
+        return;
+    }
+    if(store_depth() == 0 && mqtt_client.connected() && publish_reading(reading, false)) { return; }
+    store_push(reading);
+    MQTT_LOG(LVL_DEBUG, "MQTT", "Queued reading, depth %lu", (unsigned long)store_depth());
+}
+
+/**
+ * @brief Publish the batch, call at the end of a cycle
+ * Split over more messages if it outgrows the buffer, queued if the broker can't take it
+ * 
+ */
+void MQTT::mqtt_flush()
+{
+    batch_flush();
+}
+
+/**
+ * @brief Time since the broker session came up
+ * 
+ * @return uint32_t ms, 0 while offline
+ */
+uint32_t MQTT::mqtt_connected_ms()
+{
+    if(!mqtt_client.connected()) { return 0; }
+    uint32_t since = millis() - broker_since;
+    return since > 0 ? since : 1;
+}
+
+/**
+ * @brief Publish the metrics report and start the next
+ * MQTT_USER/MQTT_ID/metrics, layout in the README
+ * 
+ */
+void MQTT::mqtt_metrics()
+{
+    static char mqtt_topic[64];
+    static char mqtt_data[METRICS_JSON];
+    if(!mqtt_client.connected()) { return; }
+    metrics_last = millis();
+    int topic_len = snprintf(mqtt_topic, sizeof(mqtt_topic), "%s/%s/metrics", MQTT_USER, MQTT_ID);
+    size_t len = metrics_format(mqtt_data, sizeof(mqtt_data));
+    metrics_reset();
+    if(len == 0 || !mqtt_send(mqtt_topic, (const uint8_t*)mqtt_data, len)) { return; }
+    publish_bytes += topic_len + len;
+    MQTT_LOG(LVL_DEBUG, "MQTT", "Publish METRICS %u bytes", (unsigned)len);
+}
+
+/**
+ * @brief Close the broker session and turn WiFi off, before deep sleep
+ * 
+ */
+void MQTT::mqtt_sleep()
+{
+    if(mqtt_client.connected())
+    {
+        mqtt_client.disconnect();
+        /** Let the last packets leave before the radio goes */
+        delay(MQTT_SLEEP_MS);
+    }
+    WiFi.disconnect(true);
+    WiFi.mode(WIFI_OFF);
+    wifi_state = WIFI_DOWN;
+    offline = true;
+}
+
+/**
+ * @brief Publish or queue the batch
+ * 
+ */
+void batch_flush()
+{
+    uint8_t first = 0;
+    while(first < batch_count)
+    {
+        uint8_t sent = 0;
+        if(store_depth() == 0 && mqtt_client.connected())
         {
-            last_time += connect_time;
-            wifi_connect();
+            sent = PACKED ? publish_packed(batch_readings + first, batch_count - first) : publish_batch(first);
         }
+        if(sent == 0)
+        {
+            for(; first < batch_count; first++) { store_push(batch_readings[first]); }
+            MQTT_LOG(LVL_DEBUG, "MQTT", "Queued batch, depth %lu", (unsigned long)store_depth());
+            break;
+        }
+        first += sent;
     }
+    batch_count = 0;
 }
 
 /**
- * @brief Public CSV to MQTT
+ * @brief Publish queued readings, oldest first, and any log range asked for
+ * At most STORE_BATCH per call, stops at the first failed publish
  * 
- * @param data 
  */
-void MQTT::mqtt_publish(String addr, String data)
+void MQTT::mqtt_drain()
 {
-    if(mqtt_client.connected()) 
+    if(!mqtt_client.connected()) { return; }
+    if(metrics_period_s > 0 && millis() - metrics_last >= metrics_period_s * 1000) { mqtt_metrics(); }
+    publish_range();
+    if(store_depth() == 0) { return; }
+
+    if(PACKED)
     {
-        String mqtt_data = parse_data(data);
-        String mqtt_topic = String(MQTT_USER) + "/" + ZONE_NAME + "/" + addr;
-        if(CSV)
+        /** Many readings per message, the queue is where packing pays most */
+        static reading_t readings[MQTT_PACK_MAX];
+        uint8_t count = store_peek_many(readings, MQTT_PACK_MAX);
+        uint8_t sent = count > 0 ? publish_packed(readings, count) : 0;
+        for(uint8_t x = 0; x < sent; x++) { store_pop(); }
+    } else {
+        static reading_t reading;
+        uint8_t sent = 0;
+        while(sent < STORE_BATCH && store_peek(reading))
         {
-            if(mqtt_client.publish(mqtt_topic.c_str(), mqtt_data.c_str()))
-            {
-                MQTT_LOG("MQTT", "Publish CSV");
-                MQTT_LOG("MQTT", mqtt_topic);
-                MQTT_LOG("MQTT", mqtt_data);
-            }
-        } else {
-            std::stringstream ss(data.c_str());
-            std::string segment;
-            char value = 'a';
-            while(std::getline(ss, segment, '+'))
-            {
-                mqtt_topic = String(MQTT_USER) + "/" + ZONE_NAME + "/" + addr + "/" + String(value++);
-                if(mqtt_client.publish(mqtt_topic.c_str(), segment.c_str()))
-                {
-                    MQTT_LOG("MQTT", "Publish SEGMENT");
-                    MQTT_LOG("MQTT", mqtt_topic);
-                    MQTT_LOG("MQTT", String(segment.c_str()));
-                } 
-            }
+            if(!publish_reading(reading, true)) { break; }
+            store_pop();
+            sent++;
         }
     }
+    store_sync();
+    if(store_depth() == 0)
+    {
+        MQTT_LOG(LVL_INFO, "MQTT", "Queue drained, sent %lu, dropped %lu", (unsigned long)store_sent, (unsigned long)store_dropped);
+    }
 }
 
 /**
- * @brief Parse incoming string to csv
+ * @brief Publish one reading
+ * CSV on one topic, or each value on its own topic
+ * Queued readings go to .../addr/queued as epoch,CSV so they keep their time
+ * Packed carries the time either way
  * 
- * @param data 
+ * @param reading 
+ * @param queued 
+ * @return true Every publish went out
  */
-String parse_data(String data)
+bool publish_reading(const reading_t& reading, bool queued)
 {
-    String mqtt_data;
-    std::stringstream ss(data.c_str());
-    std::string segment;
-    std::vector<std::string> seglist;
-    while(std::getline(ss, segment, '+'))
+    if(PACKED) { return publish_packed(&reading, 1) == 1; }
+
+    static char mqtt_topic[64];
+    static char mqtt_data[READING_TEXT];
+    int base = snprintf(mqtt_topic, sizeof(mqtt_topic), "%s/%s/%c", MQTT_USER, ZONE_NAME.c_str(), reading.addr);
+    if(queued)
     {
-        seglist.push_back(segment);
+        snprintf(mqtt_topic + base, sizeof(mqtt_topic) - base, "/queued");
+        int n = snprintf(mqtt_data, sizeof(mqtt_data), "%lu,", (unsigned long)reading.time);
+        format_values(reading, ",", mqtt_data + n, sizeof(mqtt_data) - n);
+        if(!mqtt_send(mqtt_topic, (const uint8_t*)mqtt_data, strlen(mqtt_data))) { return false; }
+        publish_bytes += strlen(mqtt_topic) + strlen(mqtt_data);
+        MQTT_LOG(LVL_DEBUG, "MQTT", "Publish QUEUED %s %s", mqtt_topic, mqtt_data);
+    } else if(CSV) {
+        format_values(reading, ",", mqtt_data, sizeof(mqtt_data));
+        if(!mqtt_send(mqtt_topic, (const uint8_t*)mqtt_data, strlen(mqtt_data))) { return false; }
+        publish_bytes += strlen(mqtt_topic) + strlen(mqtt_data);
+        MQTT_LOG(LVL_DEBUG, "MQTT", "Publish CSV %s %s", mqtt_topic, mqtt_data);
+    } else {
+        for(int x = 0; x < reading.count; x++)
+        {
+            snprintf(mqtt_topic + base, sizeof(mqtt_topic) - base, "/%c", 'a' + x);
+            format_value(reading, x, mqtt_data, sizeof(mqtt_data));
+            if(!mqtt_send(mqtt_topic, (const uint8_t*)mqtt_data, strlen(mqtt_data))) { return false; }
+            publish_bytes += strlen(mqtt_topic) + strlen(mqtt_data);
+            MQTT_LOG(LVL_DEBUG, "MQTT", "Publish SEGMENT %s %s", mqtt_topic, mqtt_data);
+        }
     }
+    return true;
+}
 
-    uint16_t size = seglist.size();
-    for(int x = 0; x < size; x++)
+/**
+ * @brief Publish batch readings from first on, as many as fit the buffer
+ * {"zone":"[ZONE]","d":[{"a":"[ADDR]","t":[EPOCH],"v":[VALUES]},...]}
+ * An entry per reading, continuous and scheduled sensors can repeat in a cycle
+ * 
+ * @param first 
+ * @return uint8_t readings published, 0 on failure
+ */
+uint8_t publish_batch(uint8_t first)
+{
+    static char mqtt_topic[64];
+    static char mqtt_data[MQTT_BATCH_LEN];
+    static char entry[READING_TEXT + 40];
+    int topic_len = snprintf(mqtt_topic, sizeof(mqtt_topic), "%s/%s/batch", MQTT_USER, ZONE_NAME.c_str());
+    size_t cap = mqtt_client.getBufferSize() - MQTT_OVERHEAD - topic_len;
+    if(cap > sizeof(mqtt_data)) { cap = sizeof(mqtt_data); }
+
+    int n = snprintf(mqtt_data, cap, "{\"zone\":\"%s\",\"d\":[", ZONE_NAME.c_str());
+    uint8_t packed = 0;
+    for(uint8_t x = first; x < batch_count; x++)
     {
-        if (x == size-1) {
-            mqtt_data += String(seglist[x].c_str());
-        } else {
-            mqtt_data += String(seglist[x].c_str()) + ",";
-        }
+        const reading_t& reading = batch_readings[x];
+        int len = snprintf(entry, sizeof(entry), "%s{\"a\":\"%c\",\"t\":%lu,\"v\":[", packed > 0 ? "," : "",
+            reading.addr, (unsigned long)reading.time);
+        len += format_values(reading, ",", entry + len, sizeof(entry) - len - 2);
+        entry[len++] = ']';
+        entry[len++] = '}';
+        /** Leave room for the closing brackets */
+        if(n + len + 2 >= (int)cap) { break; }
+        memcpy(mqtt_data + n, entry, len);
+        n += len;
+        packed++;
     }
+    if(packed == 0) { return 0; }
+    mqtt_data[n++] = ']';
+    mqtt_data[n++] = '}';
+    mqtt_data[n] = 0;
 
-    return mqtt_data;
+    if(!mqtt_send(mqtt_topic, (const uint8_t*)mqtt_data, strlen(mqtt_data))) { return 0; }
+    publish_bytes += topic_len + n;
+    MQTT_LOG(LVL_DEBUG, "MQTT", "Publish BATCH %s %s", mqtt_topic, mqtt_data);
+    return packed;
 }
 
 /**
- * @brief Connect to Wifi
- * Use cert and secure client for SSL/TLS
+ * @brief Publish readings packed, as many as fit the buffer
+ * MQTT_USER/ZONE_NAME/packed, layout in packed.h
  * 
+ * @param readings 
+ * @param count 
+ * @return uint8_t readings published, 0 on failure
  */
-void wifi_connect()
+uint8_t publish_packed(const reading_t* readings, uint8_t count)
 {
-    uint8_t wifi_retry = 0;
-    delay(10);
+    static char mqtt_topic[64];
+    static uint8_t mqtt_data[MQTT_BATCH_LEN];
+    int topic_len = snprintf(mqtt_topic, sizeof(mqtt_topic), "%s/%s/packed", MQTT_USER, ZONE_NAME.c_str());
+    size_t cap = mqtt_client.getBufferSize() - MQTT_OVERHEAD - topic_len;
+    if(cap > sizeof(mqtt_data)) { cap = sizeof(mqtt_data); }
 
-    MQTT_LOG("WiFi", "Connecting to " + String(SSID));
+    packer_t packer;
+    pack_start(packer, mqtt_data, cap, readings[0].time);
+    for(uint8_t x = 0; x < count && pack_add(packer, readings[x]); x++) {}
+    size_t len = pack_end(packer);
+    if(packer.count == 0) { return 0; }
 
-    WiFi.setHostname("SDI-12_data_logger");
-    WiFi.begin(SSID, PASSWORD);
+    if(!mqtt_send(mqtt_topic, mqtt_data, len)) { return 0; }
+    publish_bytes += topic_len + len;
+    MQTT_LOG(LVL_DEBUG, "MQTT", "Publish PACKED %u readings, %u bytes", packer.count, (unsigned)len);
+    return packer.count;
+}
 
-    while(WiFi.status() != WL_CONNECTED)
+/**
+ * @brief Publish the next part of a log range, CMD 11
+ * MQTT_USER/ZONE_NAME/log, whole log lines, an empty message ends the range
+ * A part the broker didn't take goes again next pass
+ * 
+ */
+void publish_range()
+{
+    static char mqtt_topic[64];
+    static char chunk[MQTT_LOG_CHUNK];
+    static size_t chunk_len;
+    static bool held = false;
+    int topic_len = snprintf(mqtt_topic, sizeof(mqtt_topic), "%s/%s/log", MQTT_USER, ZONE_NAME.c_str());
+    if(!held)
     {
-        wifi_retry++;
-        if(wifi_retry == 10) 
-        { 
-            Serial.println(" Failed to connect to WiFi");
-            give_up = true;
-            break; 
-        }
-        MQTT_LOG("WiFi", "Retrying");
-        delay(500);
+        if(!logger_streaming()) { return; }
+        size_t cap = mqtt_client.getBufferSize() - MQTT_OVERHEAD - topic_len;
+        chunk_len = logger_read(chunk, cap < sizeof(chunk) ? cap : sizeof(chunk));
+        held = true;
     }
 
-    if(WiFi.status() == WL_CONNECTED)
+    if(!mqtt_send(mqtt_topic, (const uint8_t*)chunk, chunk_len)) { return; }
+    publish_bytes += topic_len + chunk_len;
+    held = false;
+    if(chunk_len == 0) { MQTT_LOG(LVL_INFO, "MQTT", "Log range sent"); }
+}
+
+/**
+ * @brief Publish and time it
+ * 
+ * @param topic 
+ * @param payload 
+ * @param len 
+ * @return true The broker took it
+ */
+bool mqtt_send(const char* topic, const uint8_t* payload, size_t len)
+{
+    uint32_t start = micros();
+    bool ok = mqtt_client.publish(topic, payload, len);
+    metrics_publish(micros() - start, ok);
+    return ok;
+}
+
+/**
+ * @brief Size the PubSubClient buffer for the publish mode
+ * Batch messages need it raised, keeps the old size if that fails
+ * 
+ */
+void mqtt_buffer()
+{
+    uint16_t size = BATCH ? MQTT_BATCH_LEN + 64 + MQTT_OVERHEAD : MQTT_BUFFER;
+    if(!mqtt_client.setBufferSize(size))
     {
-        MQTT_LOG("WiFi", "Connected");
-        MQTT_LOG("WiFi", "IP address: " + String(WiFi.localIP().toString()));
-        secure_client.setTimeout(KEEP_ALIVE);
-        secure_client.setCACert(server_root_ca);
-        give_up = false;
+        MQTT_LOG(LVL_ERROR, "MQTT", "Could not set buffer to %u", size);
     }
 }
 
 /**
- * @brief Connect to MQTT server
+ * @brief Step WiFi association
+ * WiFi.begin() returns at once, status is polled until WIFI_JOIN_MS
+ * then the next try waits out a jittered, doubling backoff
  * 
  */
-void mqtt_connect()
+void wifi_step()
 {
-    uint8_t mqtt_retry = 0;
-    while(!mqtt_client.connected() && WiFi.status() == WL_CONNECTED)
+    uint32_t now = millis();
+    if(WiFi.status() == WL_CONNECTED)
     {
-        MQTT_LOG("MQTT", "Connecting to " + String(MQTT_SERVER));
-        if(mqtt_client.connect(MQTT_ID, MQTT_USER, MQTT_PASS))
+        if(wifi_state != WIFI_UP)
         {
-            MQTT_LOG("MQTT", "Connected to broker");
-            mqtt_client.subscribe(MQTT_CONFIG.c_str());
-            give_up = false;
-        } else {
-            MQTT_LOG("MQTT", "Error code: " + String(mqtt_client.state()));
-            mqtt_retry++;
-            if(mqtt_retry == 10)
+            wifi_state = WIFI_UP;
+            wifi_backoff = BACKOFF_MIN_MS;
+            MQTT_LOG(LVL_INFO, "WiFi", "Connected, IP address: %s", WiFi.localIP().toString().c_str());
+        }
+        return;
+    }
+
+    switch(wifi_state)
+    {
+        case WIFI_UP:
+            MQTT_LOG(LVL_WARN, "WiFi", "Lost connection");
+            wifi_state = WIFI_DOWN;
+            wifi_deadline = now;
+        break;
+        case WIFI_JOINING:
+            if((int32_t)(now - wifi_deadline) >= 0)
             {
-                MQTT_LOG("MQTT", "Failed to connect to MQTT");
-                give_up = true;
-                break; 
+                WiFi.disconnect();
+                wifi_state = WIFI_DOWN;
+                wifi_deadline = now + backoff_next(wifi_backoff);
+                MQTT_LOG(LVL_WARN, "WiFi", "Failed to connect, retry in %lums", (unsigned long)(wifi_deadline - now));
             }
-            delay(5000);
-        }
+        break;
+        case WIFI_DOWN:
+            if((int32_t)(now - wifi_deadline) >= 0)
+            {
+                MQTT_LOG(LVL_INFO, "WiFi", "Connecting to %s", SSID);
+                WiFi.begin(SSID, PASSWORD);
+                wifi_state = WIFI_JOINING;
+                wifi_deadline = now + WIFI_JOIN_MS;
+            }
+        break;
     }
 }
 
+/**
+ * @brief Step the broker session, only while WiFi is up
+ * PubSubClient connects blocking, so each stage of it is bounded to fit
+ * the window, MQTT_CONNECT_S at most, no try with under a second a stage
+ * 
+ * @param window_ms Time the connect may block for
+ */
+void broker_step(uint32_t window_ms)
+{
+    if(mqtt_client.connected())
+    {
+        mqtt_client.loop();
+        return;
+    }
+    if(!offline)
+    {
+        MQTT_LOG(LVL_WARN, "MQTT", "Lost broker, error code: %d", mqtt_client.state());
+        offline = true;
+        broker_retry = millis();
+    }
+
+    uint32_t now = millis();
+    uint32_t connect_s = window_ms / 1000 / MQTT_CONNECT_STAGES;
+    if(connect_s > MQTT_CONNECT_S) { connect_s = MQTT_CONNECT_S; }
+    if(wifi_state != WIFI_UP || connect_s == 0 || (int32_t)(now - broker_retry) < 0) { return; }
+
+    secure_client.setTimeout(connect_s);
+    secure_client.setHandshakeTimeout(connect_s);
+    mqtt_client.setSocketTimeout(connect_s);
+    MQTT_LOG(LVL_INFO, "MQTT", "Connecting to %s", MQTT_SERVER);
+    broker_attempts++;
+    bool connected = mqtt_client.connect(MQTT_ID, MQTT_USER, MQTT_PASS);
+    broker_connect_ms = millis() - now;
+    if(connected)
+    {
+        MQTT_LOG(LVL_INFO, "MQTT", "Connected to broker in %lums", (unsigned long)broker_connect_ms);
+        broker_since = millis();
+        mqtt_client.subscribe(MQTT_CONFIG.c_str());
+        broker_backoff = BACKOFF_MIN_MS;
+    } else {
+        now = millis();
+        broker_retry = now + backoff_next(broker_backoff);
+        MQTT_LOG(LVL_WARN, "MQTT", "Error code: %d, retry in %lums", mqtt_client.state(), (unsigned long)(broker_retry - now));
+    }
+}
+
+/**
+ * @brief Jittered wait before the next attempt, and double the backoff
+ * Wait is between half and all of the backoff, so loggers that lost
+ * the same access point don't all come back at once
+ * 
+ * @param backoff 
+ * @return uint32_t wait, ms
+ */
+uint32_t backoff_next(uint32_t& backoff)
+{
+    uint32_t wait = backoff / 2 + random(backoff / 2 + 1);
+    backoff = backoff < BACKOFF_MAX_MS / 2 ? backoff * 2 : BACKOFF_MAX_MS;
+    return wait;
+}
+
 /**
  * @brief MQTT Downlink handler
  * 
@@ -223,9 +583,12 @@ void mqtt_downlink(char* topic, byte* message, unsigned int length)
         {
             mqtt_data += (char)message[x];
         }
+        /** Config reaches into the SDI-12 engine, which may be running on the other core */
+        sdi_lock();
         parse_config(mqtt_data);
+        sdi_unlock();
     } else {
-        MQTT_LOG("MQTT", "MQTT downlink recieved");
+        MQTT_LOG(LVL_INFO, "MQTT", "MQTT downlink recieved");
     }
 }
 
@@ -245,70 +608,243 @@ void parse_config(String data)
         seglist.push_back(segment);
     }
 
-    uint16_t cmd_int = stoi(seglist[0]);
+    /** Missing fields read as empty */
+    if(seglist.size() < DOWNLINK_FIELDS) { seglist.resize(DOWNLINK_FIELDS); }
+
+    uint32_t cmd_int;
+    uint32_t value;
+    uint32_t until;
+    uint32_t phase;
+    uint32_t priority;
+    int32_t offset;
+    char key[16];
+    if(!parse_u32(seglist[0], cmd_int)) { return; }
     switch(cmd_int)
     {
         /** CMD 0: CSV */
         case 0:
-            if(seglist[1] == "true")
-            {
-                CSV = true;
-                MQTT_LOG("MQTT", "CSV set to true");
-            } else {
-                CSV = false;
-                MQTT_LOG("MQTT", "CSV set to false");
-            }
+            if(!parse_bool(seglist[1], CSV)) { break; }
+            MQTT_LOG(LVL_INFO, "MQTT", "CSV set to %s", CSV ? "true" : "false");
             flash_bool("csv", CSV, false);
         break;
         /** CMD 1: Sleep period */
         case 1:
-            delay_time = stoi(seglist[1])*1000000;
+            if(!parse_u32(seglist[1], value)) { break; }
+            delay_time = value*1000000ULL;
             flash_64u("period", delay_time, false);
-            MQTT_LOG("MQTT", "Delay set to " + String(seglist[1].c_str()));
+            MQTT_LOG(LVL_INFO, "MQTT", "Delay set to %s", seglist[1].c_str());
         break;
         /** CMD 2: Change SDI-12 address */
         case 2:
-            MQTT_LOG("MQTT", "Change SDI12 address");
+            if(seglist[1].empty() || seglist[2].empty()) { break; }
+            MQTT_LOG(LVL_INFO, "MQTT", "Change SDI12 address");
             chng_addr(seglist[1].c_str(), seglist[2].c_str());
         break;
         /** CMD 3: Add sensor data set */
         case 3:
-            flash_32u(seglist[1].c_str(), stoi(seglist[2]), true);
-            MQTT_LOG("MQTT", "Added sensor data set");
+            if(same_word(seglist[2], "auto"))
+            {
+                flash_remove(seglist[1].c_str(), true);
+                MQTT_LOG(LVL_INFO, "MQTT", "Removed sensor data set");
+            } else if(parse_u32(seglist[2], value)) {
+                flash_32u(seglist[1].c_str(), value, true);
+                MQTT_LOG(LVL_INFO, "MQTT", "Added sensor data set");
+            }
         break;
         /** CMD 4: Use SD card */
         case 4:
-            if(seglist[1] == "true")
-            {
-                use_sd = true;
-                MQTT_LOG("SD", "Set to true, restarting...");
-            } else {
-                use_sd = false;
-                MQTT_LOG("SD", "Set to false, restarting...");
-            }
+            if(!parse_bool(seglist[1], use_sd)) { break; }
+            MQTT_LOG(LVL_INFO, "SD", "Set to %s, restarting...", use_sd ? "true" : "false");
             flash_bool("sd", use_sd, false);
+            store_flush();
             ESP.restart();
         break;
         /** CMD 5: Change GMT/DST offset */
         case 5:
-            flash_32("gmt", stoi(seglist[1]), false);
-            flash_32u("dst", stoi(seglist[2]), false);
-            MQTT_LOG("MQTT", "Changed GMT/DST, restarting...");
+            if(!parse_i32(seglist[1], offset) || !parse_u32(seglist[2], value)) { break; }
+            flash_32("gmt", offset, false);
+            flash_32u("dst", value, false);
+            MQTT_LOG(LVL_INFO, "MQTT", "Changed GMT/DST, restarting...");
+            store_flush();
             ESP.restart();
         break;
+        /** CMD 6: Concurrent measurements */
+        case 6:
+            if(!parse_bool(seglist[1], concurrent)) { break; }
+            MQTT_LOG(LVL_INFO, "MQTT", "Concurrent set to %s", concurrent ? "true" : "false");
+            flash_bool("conc", concurrent, false);
+        break;
+        /** CMD 7: Single sensor bus */
+        case 7:
+            if(!parse_bool(seglist[1], single_sensor)) { break; }
+            MQTT_LOG(LVL_INFO, "MQTT", "Single sensor set to %s", single_sensor ? "true" : "false");
+            flash_bool("single", single_sensor, false);
+        break;
+        /** CMD 8: Batch publish */
+        case 8:
+            batch_flush();
+            if(!parse_bool(seglist[1], BATCH)) { break; }
+            MQTT_LOG(LVL_INFO, "MQTT", "Batch set to %s", BATCH ? "true" : "false");
+            mqtt_buffer();
+            flash_bool("batch", BATCH, false);
+        break;
+        /** CMD 9: Packed binary payloads */
+        case 9:
+            batch_flush();
+            if(!parse_bool(seglist[1], PACKED)) { break; }
+            MQTT_LOG(LVL_INFO, "MQTT", "Packed set to %s", PACKED ? "true" : "false");
+            flash_bool("packed", PACKED, false);
+        break;
+        /** CMD 10: SD log sync interval, seconds */
+        case 10:
+            if(!parse_u32(seglist[1], log_sync_s)) { break; }
+            MQTT_LOG(LVL_INFO, "MQTT", "SD sync set to %lu", (unsigned long)log_sync_s);
+            flash_32u("fsync", log_sync_s, false);
+        break;
+        /** CMD 11: Send the SD log between two times */
+        case 11:
+            until = UINT32_MAX;
+            if(!parse_u32(seglist[1], value) || (!seglist[2].empty() && !parse_u32(seglist[2], until))) { break; }
+            if(logger_range(value, until))
+            {
+                MQTT_LOG(LVL_INFO, "MQTT", "Sending SD log range");
+            } else {
+                MQTT_LOG(LVL_INFO, "MQTT", "No SD log to send");
+            }
+        break;
+        /** CMD 12: Binary SD log records */
+        case 12:
+            if(!parse_bool(seglist[1], log_binary)) { break; }
+            MQTT_LOG(LVL_INFO, "MQTT", "SD binary set to %s", log_binary ? "true" : "false");
+            flash_bool("sdbin", log_binary, false);
+        break;
+        /** CMD 13: Deep sleep between cycles */
+        case 13:
+            if(!parse_bool(seglist[1], deep_sleep)) { break; }
+            MQTT_LOG(LVL_INFO, "MQTT", "Deep sleep set to %s", deep_sleep ? "true" : "false");
+            flash_bool("sleep", deep_sleep, false);
+        break;
+        /** CMD 14: Metrics report interval, seconds */
+        case 14:
+            if(!parse_u32(seglist[1], metrics_period_s)) { break; }
+            MQTT_LOG(LVL_INFO, "MQTT", "Metrics set to %lu", (unsigned long)metrics_period_s);
+            flash_32u("metrics", metrics_period_s, false);
+        break;
+        /** CMD 15: CRC checked data */
+        case 15:
+            if(!parse_bool(seglist[1], use_crc)) { break; }
+            MQTT_LOG(LVL_INFO, "MQTT", "CRC set to %s", use_crc ? "true" : "false");
+            flash_bool("crc", use_crc, false);
+        break;
+        /** CMD 16: Continuous reads */
+        case 16:
+            if(!sensor_key(key, 'r', seglist[1].c_str())) { break; }
+            if(same_word(seglist[2], "off"))
+            {
+                sensor_remove(key);
+                MQTT_LOG(LVL_INFO, "MQTT", "Removed continuous reads");
+            } else if(parse_u32(seglist[2], value)) {
+                sensor_32u(key, value);
+                MQTT_LOG(LVL_INFO, "MQTT", "Added continuous reads");
+            }
+        break;
+        /** CMD 17: Continuous read period */
+        case 17:
+            if(!parse_u32(seglist[1], fast_ms)) { break; }
+            MQTT_LOG(LVL_INFO, "MQTT", "Continuous period set to %lu", (unsigned long)fast_ms);
+            flash_32u("fast", fast_ms, false);
+        break;
+        /** CMD 18: Sensor schedule */
+        case 18:
+            phase = 0;
+            priority = 0;
+            if(!sensor_key(key, 's', seglist[1].c_str())) { break; }
+            if(same_word(seglist[2], "off"))
+            {
+                sensor_remove(key);
+                MQTT_LOG(LVL_INFO, "MQTT", "Removed sensor schedule");
+            } else if(parse_u32(seglist[2], value) && (seglist[3].empty() || parse_u32(seglist[3], phase)) &&
+                (seglist[4].empty() || parse_u32(seglist[4], priority))) {
+                sensor_64u(key, sched_pack(value, phase, priority));
+                MQTT_LOG(LVL_INFO, "MQTT", "Added sensor schedule");
+            }
+        break;
     }
 }
 
 /**
- * @brief Debug output text
- * 
- * @param chan Output channel
- * @param data String to output
+ * @brief Downlink field as an unsigned number
+ * Digits only, anything else is logged and left alone
+ *
+ * @param text
+ * @param value set when valid
+ * @return true valid
+ */
+bool parse_u32(const std::string& text, uint32_t& value)
+{
+    bool digits = !text.empty() && text.size() <= 10;
+    for(size_t x = 0; digits && x < text.size(); x++)
+    {
+        digits = isdigit((unsigned char)text[x]);
+    }
+    uint64_t number = digits ? strtoull(text.c_str(), nullptr, 10) : 0;
+    if(!digits || number > UINT32_MAX)
+    {
+        MQTT_LOG(LVL_WARN, "MQTT", "Ignored downlink, not a number: %s", text.c_str());
+        return false;
+    }
+    value = number;
+    return true;
+}
+
+/**
+ * @brief Downlink field as a signed number, digits with an optional -
+ *
+ * @param text
+ * @param value set when valid
+ * @return true valid
+ */
+bool parse_i32(const std::string& text, int32_t& value)
+{
+    bool negative = !text.empty() && text[0] == '-';
+    uint32_t number;
+    if(!parse_u32(negative ? text.substr(1) : text, number)) { return false; }
+    if(number > (negative ? 0x80000000UL : (uint32_t)INT32_MAX))
+    {
+        MQTT_LOG(LVL_WARN, "MQTT", "Ignored downlink, out of range: %s", text.c_str());
+        return false;
+    }
+    value = negative ? (int32_t)(0 - number) : (int32_t)number;
+    return true;
+}
+
+/**
+ * @brief Downlink field as true or false, any case
+ * Anything else is logged and left alone
+ *
+ * @param text
+ * @param value set when valid
+ * @return true valid
+ */
+bool parse_bool(const std::string& text, bool& value)
+{
+    if(same_word(text, "true") || same_word(text, "false"))
+    {
+        value = same_word(text, "true");
+        return true;
+    }
+    MQTT_LOG(LVL_WARN, "MQTT", "Ignored downlink, not true or false: %s", text.c_str());
+    return false;
+}
+
+/**
+ * @brief Downlink field matches a word, any case
+ *
+ * @param text
+ * @param word lower case
+ * @return true
  */
-void MQTT_LOG(String chan, String data)
+bool same_word(const std::string& text, const char* word)
 {
-    #if MQTT_DEBUG
-    String disp = "["+chan+"] " + data;
-    Serial.println(disp);
-    #endif
+    return strcasecmp(text.c_str(), word) == 0;
 }
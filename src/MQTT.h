@@ -13,6 +13,7 @@
 #define __MQTT_H__
 
 #include <map>
+#include <reading.h>
 
 /**
  * @brief MQTT Lib
@@ -22,19 +23,39 @@ class MQTT
 {
     public:
     void mqtt_setup();
-    void mqtt_loop();
-    void mqtt_publish(String addr, String data);
+    void mqtt_loop(uint32_t window_ms);
+    void mqtt_publish(const reading_t& reading);
+    void mqtt_flush();
+    void mqtt_drain();
+    uint32_t mqtt_connected_ms();
+    void mqtt_sleep();
+    void mqtt_metrics();
 };
 
 /** Overloads for config */
 extern uint64_t delay_time;
 extern bool CSV;
-extern bool give_up;
+extern bool BATCH;
+extern bool PACKED;
+extern bool concurrent;
+extern bool use_crc;
+extern uint32_t fast_ms;
+extern bool single_sensor;
+extern bool offline;
 extern bool use_sd;
+extern bool deep_sleep;
 void chng_addr(String addr_old, String addr_new);
+uint64_t sched_pack(uint32_t period_s, uint32_t phase_s, uint8_t priority);
+void sdi_lock();
+void sdi_unlock();
 void flash_32(const char* key, int32_t value, bool restart);
 void flash_32u(const char* key, uint32_t value, bool restart);
 void flash_64u(const char* key, uint64_t value, bool restart);
 void flash_bool(const char* key, bool value, bool restart);
+void flash_remove(const char* key, bool restart);
+bool sensor_key(char* key, char kind, const char* id);
+void sensor_32u(const char* key, uint32_t value);
+void sensor_64u(const char* key, uint64_t value);
+void sensor_remove(const char* key);
 
 #endif
@@ -0,0 +1,353 @@
+/**
+ * @file bench.cpp
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief Benchmarks for cycle time, heap churn and parse throughput
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <Arduino.h>
+#include <bench.h>
+#include <reading.h>
+#include <vector>
+#include <sstream>
+
+/** Sample D replies, address first as they come off the bus */
+const char* bench_replies[] =
+{
+    "0+21.37-0.512+1013.2+45",
+    "1+3.14159+2.718+1.414+0.5772+1.618+2.502+4.669",
+    "2-12.5+0.00012+99999+7.25-0.5+13.75+0.001+8.8+1.1",
+    "3+0.0"
+};
+/** Number of sample replies */
+const uint8_t bench_count = sizeof(bench_replies) / sizeof(bench_replies[0]);
+
+/** Cycle figures since bench_start() */
+bench_cycle_t bench_state;
+/** Counters at bench_start() */
+uint64_t bench_busy_base;
+uint32_t bench_readings_base;
+uint64_t bench_publish_base;
+uint32_t bench_allocs_base;
+uint64_t bench_bytes_base;
+/** Last loop time and cycle count seen, bench_loop() */
+uint32_t bench_last_us;
+uint32_t bench_last_cycles;
+
+/** Forward declaration */
+String legacy_strip_addr(String data);
+String legacy_parse_data(String data);
+String legacy_parse_data_sd(String data);
+size_t json_parse(const char* name, const bench_parse_t& parse, char* out, size_t len);
+
+/**
+ * @brief Time the String/stringstream path the firmware used to take
+ * against parse_values() and format_values()
+ * Both produce the MQTT CSV and the SD log line for every reply
+ *
+ * @param iterations Passes over the sample replies
+ * @param legacy
+ * @param current
+ */
+void bench_parse(uint32_t iterations, bench_parse_t& legacy, bench_parse_t& current)
+{
+    uint32_t allocs;
+    uint64_t bytes;
+    memset(&legacy, 0, sizeof(legacy));
+    memset(&current, 0, sizeof(current));
+
+    bench_heap(allocs, bytes);
+    uint32_t start = bench_us();
+    for(uint32_t x = 0; x < iterations; x++)
+    {
+        for(uint8_t y = 0; y < bench_count; y++)
+        {
+            String stripped = legacy_strip_addr(String(bench_replies[y]));
+            String mqtt_data = legacy_parse_data(stripped);
+            String log_data = legacy_parse_data_sd(stripped);
+            legacy.bytes_in += strlen(bench_replies[y]);
+            legacy.bytes_out += mqtt_data.length() + log_data.length();
+            legacy.replies++;
+        }
+    }
+    legacy.us = bench_us() - start;
+    bench_heap(legacy.allocs, legacy.alloc_bytes);
+    legacy.allocs -= allocs;
+    legacy.alloc_bytes -= bytes;
+
+    static reading_t reading;
+    static char mqtt_data[READING_TEXT];
+    static char log_data[READING_TEXT];
+    bench_heap(allocs, bytes);
+    start = bench_us();
+    for(uint32_t x = 0; x < iterations; x++)
+    {
+        for(uint8_t y = 0; y < bench_count; y++)
+        {
+            reading.count = 0;
+            reading.truncated = 0;
+            parse_values(bench_replies[y], reading);
+            current.bytes_out += format_values(reading, ",", mqtt_data, sizeof(mqtt_data));
+            current.bytes_out += format_values(reading, ", ", log_data, sizeof(log_data));
+            current.bytes_in += strlen(bench_replies[y]);
+            current.replies++;
+        }
+    }
+    current.us = bench_us() - start;
+    bench_heap(current.allocs, current.alloc_bytes);
+    current.allocs -= allocs;
+    current.alloc_bytes -= bytes;
+}
+
+/**
+ * @brief Reset cycle figures, counts from here on
+ *
+ */
+void bench_start()
+{
+    memset(&bench_state, 0, sizeof(bench_state));
+    bench_state.cycle_min = UINT32_MAX;
+    bench_state.heap_min = UINT32_MAX;
+    bench_busy_base = bus_busy_us;
+    bench_readings_base = sdi_readings;
+    bench_publish_base = publish_bytes;
+    bench_state.heap_tracked = bench_heap(bench_allocs_base, bench_bytes_base);
+    bench_last_us = micros();
+    bench_last_cycles = sdi_cycles;
+}
+
+/**
+ * @brief Update cycle figures, call once per loop() pass
+ *
+ * @param loop_us Time the pass took
+ * @return true A measurement cycle just finished
+ */
+bool bench_loop(uint32_t loop_us)
+{
+    uint32_t now = micros();
+    bench_state.elapsed_us += now - bench_last_us;
+    bench_last_us = now;
+    if(loop_us > bench_state.loop_max_us) { bench_state.loop_max_us = loop_us; }
+
+    bench_state.readings = sdi_readings - bench_readings_base;
+    if(bench_state.first_reading_ms == 0 && bench_state.readings > 0)
+    {
+        bench_state.first_reading_ms = bench_state.elapsed_us / 1000;
+    }
+    if(sdi_cycles == bench_last_cycles) { return false; }
+    bench_last_cycles = sdi_cycles;
+
+    bench_state.cycles++;
+    if(cycle_ms < bench_state.cycle_min) { bench_state.cycle_min = cycle_ms; }
+    if(cycle_ms > bench_state.cycle_max) { bench_state.cycle_max = cycle_ms; }
+    bench_state.cycle_sum += cycle_ms;
+    bench_state.sensors = __builtin_popcountll(online_mask);
+    bench_state.bus_busy_us = bus_busy_us - bench_busy_base;
+    bench_state.publish_bytes = publish_bytes - bench_publish_base;
+    if(bench_heap(bench_state.allocs, bench_state.alloc_bytes))
+    {
+        bench_state.allocs -= bench_allocs_base;
+        bench_state.alloc_bytes -= bench_bytes_base;
+    }
+    bench_state.heap_free = ESP.getFreeHeap();
+    if(bench_state.heap_free < bench_state.heap_min) { bench_state.heap_min = bench_state.heap_free; }
+    return true;
+}
+
+/**
+ * @brief Cycle figures so far
+ *
+ * @return const bench_cycle_t&
+ */
+const bench_cycle_t& bench_result()
+{
+    return bench_state;
+}
+
+/**
+ * @brief Format a report as one JSON line
+ * Per reading figures divide by readings, so runs with different
+ * sensor counts and cycle counts compare
+ *
+ * @param cycle nullptr to leave out
+ * @param legacy nullptr to leave out parse figures
+ * @param current
+ * @param out
+ * @param len
+ * @return size_t characters written
+ */
+size_t bench_json(const bench_cycle_t* cycle, const bench_parse_t* legacy, const bench_parse_t* current, char* out, size_t len)
+{
+    size_t n = snprintf(out, len, "{");
+    if(cycle != nullptr && n < len)
+    {
+        double readings = cycle->readings > 0 ? cycle->readings : 1;
+        double busy = cycle->elapsed_us > 0 ? (double)cycle->bus_busy_us / cycle->elapsed_us : 0;
+        n += snprintf(out + n, len - n,
+            "\"cycle\":{\"sensors\":%u,\"cycles\":%u,\"cycle_ms\":{\"min\":%u,\"avg\":%u,\"max\":%u},"
+            "\"first_reading_ms\":%u,\"readings\":%u,\"bus_idle\":%.4f,\"publish_bytes_per_reading\":%.1f,"
+            "\"heap\":{\"tracked\":%s,\"allocs_per_reading\":%.2f,\"bytes_per_reading\":%.1f,\"free\":%u,\"min_free\":%u},"
+            "\"loop_max_us\":%u}",
+            cycle->sensors, cycle->cycles,
+            cycle->cycles > 0 ? cycle->cycle_min : 0,
+            cycle->cycles > 0 ? (uint32_t)(cycle->cycle_sum / cycle->cycles) : 0,
+            cycle->cycle_max, cycle->first_reading_ms, cycle->readings, 1.0 - busy,
+            cycle->publish_bytes / readings,
+            cycle->heap_tracked ? "true" : "false", cycle->allocs / readings, cycle->alloc_bytes / readings,
+            cycle->heap_free, cycle->heap_min == UINT32_MAX ? 0 : cycle->heap_min,
+            cycle->loop_max_us);
+    }
+    if(legacy != nullptr && current != nullptr && n < len)
+    {
+        if(n > 1) { n += snprintf(out + n, len - n, ","); }
+        n += snprintf(out + n, len - n, "\"parse\":{");
+        if(n < len) { n += json_parse("legacy", *legacy, out + n, len - n); }
+        if(n < len) { n += snprintf(out + n, len - n, ","); }
+        if(n < len) { n += json_parse("current", *current, out + n, len - n); }
+        if(n < len) { n += snprintf(out + n, len - n, "}"); }
+    }
+    if(n < len) { n += snprintf(out + n, len - n, "}"); }
+    return n < len ? n : len - 1;
+}
+
+/**
+ * @brief Format one parse path
+ *
+ * @param name
+ * @param parse
+ * @param out
+ * @param len
+ * @return size_t characters written
+ */
+size_t json_parse(const char* name, const bench_parse_t& parse, char* out, size_t len)
+{
+    double replies = parse.replies > 0 ? parse.replies : 1;
+    double secs = parse.us > 0 ? parse.us / 1e6 : 1e-6;
+    int n = snprintf(out, len,
+        "\"%s\":{\"replies\":%u,\"us_per_reply\":%.3f,\"replies_per_s\":%.0f,\"bytes_in_per_s\":%.0f,"
+        "\"allocs_per_reply\":%.2f,\"alloc_bytes_per_reply\":%.1f,\"bytes_out_per_reply\":%.1f}",
+        name, parse.replies, parse.us / replies, parse.replies / secs, parse.bytes_in / secs,
+        parse.allocs / replies, parse.alloc_bytes / replies, parse.bytes_out / replies);
+    return n > 0 ? n : 0;
+}
+
+/**
+ * @brief Benchmark clock, micros
+ * The native build swaps in host wall time
+ *
+ * @return uint32_t
+ */
+__attribute__((weak)) uint32_t bench_us()
+{
+    return micros();
+}
+
+/**
+ * @brief Heap allocations so far
+ * The device has no allocation hook, the native build counts operator new
+ *
+ * @param allocs
+ * @param bytes
+ * @return true Counts are real
+ */
+__attribute__((weak)) bool bench_heap(uint32_t& allocs, uint64_t& bytes)
+{
+    allocs = 0;
+    bytes = 0;
+    return false;
+}
+
+/**
+ * @brief Old reply path, strip the SDI-12 address
+ * Kept as the benchmark baseline, splits on '+' the way it always did
+ *
+ * @param data
+ * @return String
+ */
+String legacy_strip_addr(String data)
+{
+    std::stringstream ss(data.c_str());
+    std::string segment;
+    std::vector<std::string> seglist;
+    String stripped;
+    while(std::getline(ss, segment, '+'))
+    {
+        seglist.push_back(segment);
+    }
+
+    uint16_t size = seglist.size();
+    for(int x = 1; x < size; x++)
+    {
+        if(x == size-1) {
+            stripped += String(seglist[x].c_str());
+        } else {
+            stripped += String(seglist[x].c_str()) + "+";
+        }
+    }
+
+    return stripped;
+}
+
+/**
+ * @brief Old MQTT path, values to CSV
+ *
+ * @param data
+ * @return String
+ */
+String legacy_parse_data(String data)
+{
+    String mqtt_data;
+    std::stringstream ss(data.c_str());
+    std::string segment;
+    std::vector<std::string> seglist;
+    while(std::getline(ss, segment, '+'))
+    {
+        seglist.push_back(segment);
+    }
+
+    uint16_t size = seglist.size();
+    for(int x = 0; x < size; x++)
+    {
+        if(x == size-1) {
+            mqtt_data += String(seglist[x].c_str());
+        } else {
+            mqtt_data += String(seglist[x].c_str()) + ",";
+        }
+    }
+
+    return mqtt_data;
+}
+
+/**
+ * @brief Old SD path, values to ", " separated text
+ *
+ * @param data
+ * @return String
+ */
+String legacy_parse_data_sd(String data)
+{
+    String log_data;
+    std::stringstream ss(data.c_str());
+    std::string segment;
+    std::vector<std::string> seglist;
+    while(std::getline(ss, segment, '+'))
+    {
+        seglist.push_back(segment);
+    }
+
+    uint16_t size = seglist.size();
+    for(int x = 0; x < size; x++)
+    {
+        if(x == size-1) {
+            log_data += String(seglist[x].c_str());
+        } else {
+            log_data += String(seglist[x].c_str()) + ", ";
+        }
+    }
+
+    return log_data;
+}
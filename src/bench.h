@@ -0,0 +1,102 @@
+/**
+ * @file bench.h
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief Benchmarks for cycle time, heap churn and parse throughput
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef __bench_H__
+#define __bench_H__
+
+#include <Arduino.h>
+
+/** Parse benchmark passes over the sample replies */
+#define BENCH_PARSE_ITER 2000
+/** Longest JSON line a report formats to */
+#define BENCH_JSON 768
+
+/**
+ * @brief One parse path timed over the sample replies
+ *
+ */
+struct bench_parse_t
+{
+    /** Replies parsed and formatted */
+    uint32_t replies;
+    /** Reply bytes in */
+    uint32_t bytes_in;
+    /** Text bytes out, MQTT CSV + SD log */
+    uint32_t bytes_out;
+    /** Total time, micros */
+    uint32_t us;
+    /** Heap allocations */
+    uint32_t allocs;
+    /** Heap bytes allocated */
+    uint64_t alloc_bytes;
+};
+
+/**
+ * @brief Measurement cycle figures, reset by bench_start()
+ *
+ */
+struct bench_cycle_t
+{
+    /** Sensors online */
+    uint8_t sensors;
+    /** Cycles seen */
+    uint32_t cycles;
+    /** Cycle time min/max/sum, ms */
+    uint32_t cycle_min;
+    uint32_t cycle_max;
+    uint64_t cycle_sum;
+    /** Time to the first reading after bench_start(), ms */
+    uint32_t first_reading_ms;
+    /** Readings since bench_start() */
+    uint32_t readings;
+    /** Time the bus carried traffic since bench_start(), micros */
+    uint64_t bus_busy_us;
+    /** Time since bench_start(), micros */
+    uint64_t elapsed_us;
+    /** MQTT topic + payload bytes since bench_start() */
+    uint64_t publish_bytes;
+    /** Heap allocations and bytes since bench_start() */
+    uint32_t allocs;
+    uint64_t alloc_bytes;
+    /** Worst loop() pass, micros */
+    uint32_t loop_max_us;
+    /** Free heap now and lowest seen, bytes */
+    uint32_t heap_free;
+    uint32_t heap_min;
+    /** Allocation counts are real, not just free heap */
+    bool heap_tracked;
+};
+
+/**
+ * @brief Benchmarks
+ * Host numbers come from the native build, on the device
+ * build with -D BENCH=1 (env:bench) for a JSON line per cycle
+ *
+ */
+void bench_parse(uint32_t iterations, bench_parse_t& legacy, bench_parse_t& current);
+void bench_start();
+bool bench_loop(uint32_t loop_us);
+const bench_cycle_t& bench_result();
+size_t bench_json(const bench_cycle_t* cycle, const bench_parse_t* legacy, const bench_parse_t* current, char* out, size_t len);
+
+/** Clock and heap hooks, the native build overrides these */
+uint32_t bench_us();
+bool bench_heap(uint32_t& allocs, uint64_t& bytes);
+
+/** Overloads for bench */
+extern uint64_t bus_busy_us;
+extern uint32_t sdi_cycles;
+extern uint32_t sdi_readings;
+extern uint32_t cycle_ms;
+extern uint64_t online_mask;
+extern uint64_t publish_bytes;
+
+#endif
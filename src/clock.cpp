@@ -0,0 +1,116 @@
+/**
+ * @file clock.cpp
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief Epoch time anchored to the esp_timer at each NTP sync
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <Arduino.h>
+#include <clock.h>
+#include <debug.h>
+#include <esp_timer.h>
+#include <esp_sntp.h>
+#include <esp_attr.h>
+#include <sys/time.h>
+#include <atomic>
+
+/** Epoch minus esp_timer, micros, 0 until the first sync */
+std::atomic<int64_t> clock_offset_us{0};
+/** Sync quality */
+clock_sync_t clock_sync;
+/** Sync quality through deep sleep, the RTC keeps the time itself */
+RTC_DATA_ATTR clock_sync_t rtc_sync;
+/** Clock was set when we went to sleep */
+RTC_DATA_ATTR bool rtc_synced = false;
+
+/** Forward declaration */
+void clock_synced(struct timeval* tv);
+
+/**
+ * @brief Start SNTP, returns at once
+ * Until the first sync get_epoch() returns 0, readings are marked unset
+ *
+ * @param gmt_offset
+ * @param dst_offset
+ * @param server
+ */
+void clock_setup(int32_t gmt_offset, uint32_t dst_offset, const char* server)
+{
+    if(rtc_synced)
+    {
+        /** esp_timer starts over on wake, the RTC kept counting */
+        struct timeval tv;
+        gettimeofday(&tv, nullptr);
+        clock_offset_us.store((int64_t)tv.tv_sec * 1000000 + tv.tv_usec - esp_timer_get_time());
+        clock_sync = rtc_sync;
+        rtc_synced = false;
+        CLOCK_LOG(LVL_INFO, "CLOCK", "Kept through sleep, last sync %lu", (unsigned long)clock_sync.last);
+    }
+    sntp_set_time_sync_notification_cb(clock_synced);
+    configTime(gmt_offset, dst_offset, server);
+    CLOCK_LOG(LVL_INFO, "CLOCK", "Waiting on %s", server);
+}
+
+/**
+ * @brief Epoch seconds, O(1) and never blocks
+ *
+ * @return uint32_t 0 before the first sync
+ */
+uint32_t get_epoch()
+{
+    return get_epoch_ms() / 1000;
+}
+
+/**
+ * @brief Epoch milliseconds, O(1) and never blocks
+ *
+ * @return uint64_t 0 before the first sync
+ */
+uint64_t get_epoch_ms()
+{
+    int64_t offset = clock_offset_us.load(std::memory_order_relaxed);
+    if(offset == 0) { return 0; }
+    return (offset + esp_timer_get_time()) / 1000;
+}
+
+/**
+ * @brief Keep the sync state through deep sleep
+ * A wake re-anchors to the RTC before SNTP has a chance to run
+ *
+ */
+void clock_sleep()
+{
+    rtc_sync = clock_sync;
+    rtc_synced = clock_offset_us.load() != 0;
+}
+
+/**
+ * @brief SNTP set the system time, re-anchor and note how far off we were
+ * Runs in the SNTP task
+ *
+ * @param tv Time just set
+ */
+void clock_synced(struct timeval* tv)
+{
+    int64_t now = esp_timer_get_time();
+    int64_t epoch_us = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+    if(tv->tv_sec < EPOCH_VALID) { return; }
+
+    int64_t old = clock_offset_us.exchange(epoch_us - now);
+    if(old != 0)
+    {
+        int32_t correction = (old - (epoch_us - now)) / 1000;
+        clock_sync.correction_ms = correction;
+        uint32_t size = correction < 0 ? -correction : correction;
+        if(size > clock_sync.worst_ms) { clock_sync.worst_ms = size; }
+    } else {
+        clock_sync.first_ms = now / 1000;
+    }
+    clock_sync.syncs++;
+    clock_sync.last = tv->tv_sec;
+    CLOCK_LOG(LVL_INFO, "CLOCK", "Synced, correction %ldms", (long)clock_sync.correction_ms);
+}
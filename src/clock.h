@@ -0,0 +1,51 @@
+/**
+ * @file clock.h
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief Epoch time anchored to the esp_timer at each NTP sync
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef __clock_H__
+#define __clock_H__
+
+#include <Arduino.h>
+
+/** Epochs before this were never set, 2020-01-01 */
+#define EPOCH_VALID 1577836800
+
+/**
+ * @brief How the clock was last synced
+ *
+ */
+struct clock_sync_t
+{
+    /** NTP syncs since power on, deep sleep included */
+    uint32_t syncs;
+    /** Epoch of the last sync, 0 for never */
+    uint32_t last;
+    /** Boot to the first sync, ms */
+    uint32_t first_ms;
+    /** How far the anchored clock was off at the last sync, ms, + was ahead */
+    int32_t correction_ms;
+    /** Largest correction seen, either way, ms */
+    uint32_t worst_ms;
+};
+
+/**
+ * @brief SNTP runs in the background and re-anchors the clock on every sync
+ * Reads never touch SNTP or the RTC, they add the esp_timer to the anchor
+ *
+ */
+void clock_setup(int32_t gmt_offset, uint32_t dst_offset, const char* server);
+uint32_t get_epoch();
+uint64_t get_epoch_ms();
+void clock_sleep();
+
+/** Sync quality */
+extern clock_sync_t clock_sync;
+
+#endif
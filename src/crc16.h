@@ -0,0 +1,25 @@
+/**
+ * @file crc16.h
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief CRC-16 as SDI-12 uses it
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef __crc16_H__
+#define __crc16_H__
+
+#include <Arduino.h>
+
+/**
+ * @brief CRC-16/ARC, polynomial 0xA001 reflected, starts at 0
+ * The SDI-12 spec's CRC, also on binary log records
+ * Pass the last result as crc to continue over more data
+ *
+ */
+uint16_t crc16(const uint8_t* data, size_t len, uint16_t crc = 0);
+
+#endif
@@ -0,0 +1,134 @@
+/**
+ * @file debug.cpp
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief Serial debug output with compile time levels per module
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <Arduino.h>
+#include <debug.h>
+#include <stdarg.h>
+
+/** Lines dropped with the ring full */
+uint32_t debug_dropped;
+#if DEBUG_RING
+/** Lines waiting on the UART */
+char debug_ring[DEBUG_RING];
+/** Next byte in, next byte out, free running */
+uint32_t ring_head;
+uint32_t ring_tail;
+#ifdef ESP32
+/** Any task may print */
+portMUX_TYPE debug_mux = portMUX_INITIALIZER_UNLOCKED;
+#endif
+#endif
+
+/** Forward declaration */
+void debug_lock();
+void debug_unlock();
+
+/**
+ * @brief Print a line, [chan] message
+ *
+ * @param chan
+ * @param fmt printf format
+ */
+void debug_print(const char* chan, const char* fmt, ...)
+{
+    char line[DEBUG_LINE];
+    int n = snprintf(line, sizeof(line), "[%s] ", chan);
+    if(n < 0 || n >= (int)sizeof(line) - 2) { return; }
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(line + n, sizeof(line) - n - 2, fmt, args);
+    va_end(args);
+    if(len < 0) { return; }
+    len = n + len < (int)sizeof(line) - 3 ? n + len : sizeof(line) - 3;
+
+    #if DEBUG_RING
+    line[len++] = '\r';
+    line[len++] = '\n';
+    debug_lock();
+    if(DEBUG_RING - (ring_head - ring_tail) < (uint32_t)len)
+    {
+        debug_dropped++;
+    } else {
+        for(int x = 0; x < len; x++) { debug_ring[(ring_head + x) % DEBUG_RING] = line[x]; }
+        ring_head += len;
+    }
+    debug_unlock();
+    #else
+    Serial.println(line);
+    #endif
+}
+
+/**
+ * @brief Hand the UART what it can take without waiting
+ * Call often, one task at a time
+ *
+ */
+void debug_flush()
+{
+    #if DEBUG_RING
+    debug_lock();
+    uint32_t head = ring_head;
+    debug_unlock();
+
+    uint32_t pending = head - ring_tail;
+    if(pending == 0) { return; }
+    int room = Serial.availableForWrite();
+    if(room <= 0) { return; }
+    uint32_t start = ring_tail % DEBUG_RING;
+    uint32_t len = DEBUG_RING - start;
+    if(len > pending) { len = pending; }
+    if(len > (uint32_t)room) { len = room; }
+    Serial.write((const uint8_t*)debug_ring + start, len);
+
+    debug_lock();
+    ring_tail += len;
+    debug_unlock();
+    #endif
+}
+
+/**
+ * @brief Write out everything queued, waits on the UART
+ * Before a restart or deep sleep
+ *
+ */
+void debug_drain()
+{
+    #if DEBUG_RING
+    debug_lock();
+    uint32_t head = ring_head;
+    debug_unlock();
+    while(ring_tail != head)
+    {
+        uint32_t start = ring_tail % DEBUG_RING;
+        uint32_t len = DEBUG_RING - start;
+        if(len > head - ring_tail) { len = head - ring_tail; }
+        Serial.write((const uint8_t*)debug_ring + start, len);
+        debug_lock();
+        ring_tail += len;
+        debug_unlock();
+    }
+    #endif
+    Serial.flush();
+}
+
+void debug_lock()
+{
+    #if DEBUG_RING && defined(ESP32)
+    portENTER_CRITICAL(&debug_mux);
+    #endif
+}
+
+void debug_unlock()
+{
+    #if DEBUG_RING && defined(ESP32)
+    portEXIT_CRITICAL(&debug_mux);
+    #endif
+}
@@ -0,0 +1,80 @@
+/**
+ * @file debug.h
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief Serial debug output with compile time levels per module
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef __debug_H__
+#define __debug_H__
+
+#include <Arduino.h>
+
+/** Message levels, a module prints what is at or below its level */
+#define LVL_NONE 0
+#define LVL_ERROR 1
+#define LVL_WARN 2
+#define LVL_INFO 3
+#define LVL_DEBUG 4
+
+/** Level for every module, i.e -D DEBUG_LEVEL=LVL_WARN */
+#ifndef DEBUG_LEVEL
+#define DEBUG_LEVEL LVL_DEBUG
+#endif
+/** Module levels, i.e -D SDI_LEVEL=LVL_NONE */
+#ifndef R_LEVEL
+#define R_LEVEL DEBUG_LEVEL
+#endif
+#ifndef SDI_LEVEL
+#define SDI_LEVEL DEBUG_LEVEL
+#endif
+#ifndef MQTT_LEVEL
+#define MQTT_LEVEL DEBUG_LEVEL
+#endif
+#ifndef LOGGER_LEVEL
+#define LOGGER_LEVEL DEBUG_LEVEL
+#endif
+#ifndef CLOCK_LEVEL
+#define CLOCK_LEVEL DEBUG_LEVEL
+#endif
+
+/** Longest line, channel included, longer lines are cut */
+#define DEBUG_LINE 160
+/** Lines queue here and go out as the UART has room, bytes, 0 writes straight to Serial */
+#ifndef DEBUG_RING
+#ifdef ESP32
+#define DEBUG_RING 2048
+#else
+#define DEBUG_RING 0
+#endif
+#endif
+
+/**
+ * @brief Print printf style on a channel, i.e SDI_LOG(LVL_DEBUG, "SDI-12", "Sent: %s", cmd)
+ * Above the module's level the arguments are never evaluated and the call compiles out
+ *
+ */
+#define DEBUG_PRINT(module, level, chan, ...) do { if((level) <= (module)) { debug_print(chan, __VA_ARGS__); } } while(0)
+#define R_LOG(level, chan, ...) DEBUG_PRINT(R_LEVEL, level, chan, __VA_ARGS__)
+#define SDI_LOG(level, chan, ...) DEBUG_PRINT(SDI_LEVEL, level, chan, __VA_ARGS__)
+#define MQTT_LOG(level, chan, ...) DEBUG_PRINT(MQTT_LEVEL, level, chan, __VA_ARGS__)
+#define LOGGER_LOG(level, chan, ...) DEBUG_PRINT(LOGGER_LEVEL, level, chan, __VA_ARGS__)
+#define CLOCK_LOG(level, chan, ...) DEBUG_PRINT(CLOCK_LEVEL, level, chan, __VA_ARGS__)
+
+/**
+ * @brief Formats on the stack, never allocates
+ * With the ring nothing waits on the UART, lines that don't fit are dropped
+ *
+ */
+void debug_print(const char* chan, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+void debug_flush();
+void debug_drain();
+
+/** Lines dropped with the ring full */
+extern uint32_t debug_dropped;
+
+#endif
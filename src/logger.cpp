@@ -10,16 +10,20 @@
  */
 #include <Arduino.h>
 #include <logger.h>
+#include <crc16.h>
+#include <clock.h>
+#include <metrics.h>
+#include <debug.h>
 #include <SPI.h>
 #include <SD.h>
 #include <time.h>
-#include <vector>
-#include <sstream>
 
 /** Configurage switch */
 bool use_sd = true;
 /** Logic switch */
 bool use_log = false;
+/** Log binary records instead of text lines */
+bool log_binary = false;
 /** Card found switch */
 bool card_found = false;
 /** Time server */
@@ -29,17 +33,87 @@ int32_t gmtoffset_sec = 0;
 /** Daylight savings time offset */
 uint32_t daylightoffset_sec = 0;
 
-/** Turn on/off LOGGER debug output*/
-#define LOGGER_DEBUG 1
+/** Log lines held in RAM between writes to the card */
+#define LOG_BUFFER 4096
+/** Longest log line, timestamp, values and CRLF like println, records are shorter */
+#define LOG_LINE (READING_TEXT + 24)
+/** Write the buffer out once its oldest line is this old */
+#define LOG_AGE_MS 30000
+/** Log files, /log/YYYYMMDD_N.txt per local day, the next N once one is full */
+#define LOG_DIR "/log"
+#define LOG_FILE_MAX 1048576
+#define LOG_FILES_DAY 100
+#define LOG_PATH 48
+/** Seconds between index entries */
+#define LOG_INDEX_S 60
+/** Days one range request walks */
+#define LOG_RANGE_DAYS 31
 
-/** File instance to hold log */
+/**
+ * @brief Index entry, /log/YYYYMMDD_N.idx is an array of them
+ * A write of buffered lines starting at offset, the first line taken at epoch
+ * 
+ */
+struct log_index_t
+{
+  uint32_t epoch;
+  uint32_t offset;
+};
+
+/** File instance to hold log, open while the card is in use */
 File r4k_file;
+/** Index of the open log file */
+File idx_file;
+/** Local day and format of the open log file, and its size */
+uint32_t file_day = 0;
+bool file_binary = false;
+uint32_t file_size = 0;
+/** Epoch of the last index entry, 0 for none in the open file */
+uint32_t index_epoch = 0;
+/** Lines waiting for the card */
+char log_buffer[LOG_BUFFER];
+size_t log_len = 0;
+/** When the oldest buffered line was added, ms */
+uint32_t log_first = 0;
+/** Local day, epoch and format of the oldest buffered line */
+uint32_t buf_day = 0;
+uint32_t buf_epoch = 0;
+bool buf_binary = false;
+/** Seconds between syncs to the card, 0 syncs every write */
+uint32_t log_sync_s = 60;
+/** Last sync, ms */
+uint32_t log_synced = 0;
+/** Range being streamed by logger_read, the file, where it ends and the next to open */
+File range_file;
+uint32_t range_end = 0;
+uint32_t range_from = 0;
+uint32_t range_to = 0;
+uint32_t range_day = 0;
+uint32_t range_last = 0;
+uint8_t range_num = 0;
+bool range_binary = false;
+bool range_active = false;
+#ifdef ESP32
+/** Held while the buffer or file is in use, the shutdown hook runs on any task */
+SemaphoreHandle_t log_mutex = nullptr;
+#endif
 
 void setup_sd();
 void setup_rtc();
-String get_timestamp();
-String parse_data_sd(String data);
-void LOGGER_LOG(String chan, String data);
+size_t format_timestamp(uint32_t epoch, char* out, size_t len);
+size_t format_record(const reading_t& reading, uint8_t* out);
+size_t record_cut(const uint8_t* data, size_t len);
+time_t local_time(uint32_t epoch);
+uint32_t local_day(uint32_t epoch);
+void log_write();
+void log_open(uint32_t day);
+void log_close();
+void log_path(uint32_t day, uint8_t num, const char* ext, char* out, size_t len);
+bool log_exists(uint32_t day, uint8_t num);
+bool range_open();
+uint32_t index_search(File& idx, uint32_t count, uint32_t epoch, bool equal);
+void log_lock();
+void log_unlock();
 
 /**
  * @brief Setup logger
@@ -47,8 +121,12 @@ void LOGGER_LOG(String chan, String data);
  */
 void LOGGER::logger_setup() 
 {
+  #ifdef ESP32
+  if(log_mutex == nullptr) { log_mutex = xSemaphoreCreateMutex(); }
+  #endif
   setup_rtc();
   setup_sd();
+  esp_register_shutdown_handler(logger_shutdown);
 }
 
 /**
@@ -59,118 +137,501 @@ void setup_sd()
 {
   if(use_sd)
   {
-    LOGGER_LOG("LOG", "SD begin");
+    LOGGER_LOG(LVL_DEBUG, "LOG", "SD begin");
     if (!SD.begin()) 
     {
-      LOGGER_LOG("LOG", "SD init failed");
+      LOGGER_LOG(LVL_ERROR, "LOG", "SD init failed");
       card_found = false;
     } else {
-      LOGGER_LOG("LOG", "SD init success");
+      LOGGER_LOG(LVL_INFO, "LOG", "SD init success");
       card_found = true;
     }
   }
 }
 
 /**
- * @brief Write to SD card
+ * @brief Buffer a reading for the SD card
+ * Written out when the buffer fills, from logger_loop once it ages, or on shutdown
  * 
- * @param data String to write to SD log file
+ * @param reading Reading to write to SD log file
  */
-void LOGGER::write_sd(String data)
+void LOGGER::write_sd(const reading_t& reading)
 {
   if(use_sd && card_found && use_log)
   {
-    r4k_file = SD.open("/sdi12log.txt", FILE_APPEND);
-    data = parse_data_sd(data);
+    char line[LOG_LINE];
+    uint32_t day = local_day(reading.time);
+    bool binary = log_binary;
+    size_t len;
+    if(binary)
+    {
+      len = format_record(reading, (uint8_t*)line);
+    } else {
+      len = format_timestamp(reading.time, line, sizeof(line));
+      line[len++] = ' ';
+      len += format_values(reading, ", ", line + len, sizeof(line) - len - 2);
+      line[len++] = '\r';
+      line[len++] = '\n';
+    }
 
-    if(r4k_file)
+    log_lock();
+    /** A write never spans days or formats, so it lands in one file */
+    if(log_len + len > LOG_BUFFER || (log_len > 0 && (day != buf_day || binary != buf_binary))) { log_write(); }
+    if(log_len == 0)
     {
-      r4k_file.println(get_timestamp() + " " + data);
-      LOGGER_LOG("LOG", "Wrote " + get_timestamp() + " " + data);
-      r4k_file.close();
+      log_first = millis();
+      buf_day = day;
+      buf_epoch = reading.time;
+      buf_binary = binary;
+    }
+    memcpy(log_buffer + log_len, line, len);
+    log_len += len;
+    log_unlock();
+  }
+}
+
+/**
+ * @brief Write out buffered lines once the oldest has waited LOG_AGE_MS
+ * 
+ */
+void LOGGER::logger_loop()
+{
+  log_lock();
+  if(log_len > 0 && millis() - log_first >= LOG_AGE_MS) { log_write(); }
+  log_unlock();
+}
+
+/**
+ * @brief Write out and sync everything buffered, then close the log
+ * Registered as a shutdown handler so ESP.restart() runs it, call before deep sleep
+ * 
+ */
+void logger_shutdown()
+{
+  log_lock();
+  log_write();
+  log_close();
+  range_file.close();
+  range_active = false;
+  log_unlock();
+}
+
+/**
+ * @brief Start streaming the log lines between two times
+ * Widened to the index entries around them, so a little before and after comes too
+ * At most LOG_RANGE_DAYS days from the start, nothing past now
+ * 
+ * @param from Epoch seconds
+ * @param to Epoch seconds
+ * @return true There is a card to read, logger_read() returns the lines
+ */
+bool logger_range(uint32_t from, uint32_t to)
+{
+  if(!use_sd || !card_found) { return false; }
+
+  log_lock();
+  /** Lines still in RAM or unsynced are not visible to another handle */
+  log_write();
+  if(r4k_file)
+  {
+    r4k_file.flush();
+    idx_file.flush();
+    log_synced = millis();
+  }
+
+  uint32_t now = get_epoch();
+  if(now != 0 && to > now) { to = now; }
+  range_file.close();
+  range_from = from;
+  range_to = to;
+  range_day = local_day(from);
+  range_last = local_day(to);
+  if(range_last - range_day >= LOG_RANGE_DAYS) { range_last = range_day + LOG_RANGE_DAYS - 1; }
+  range_num = 0;
+  range_active = from <= to;
+  log_unlock();
+
+  LOGGER_LOG(LVL_INFO, "LOG", "Range %lu to %lu", (unsigned long)from, (unsigned long)to);
+  return range_active;
+}
+
+/**
+ * @brief Read the next part of the range, whole lines or records unless one outgrows out
+ * 
+ * @param out 
+ * @param len size of out
+ * @return size_t Bytes read, 0 when the range is done
+ */
+size_t logger_read(char* out, size_t len)
+{
+  size_t n = 0;
+  log_lock();
+  while(range_active && n == 0)
+  {
+    if(!range_file && !range_open())
+    {
+      range_active = false;
+      break;
+    }
+
+    uint32_t pos = range_file.position();
+    n = range_end - pos < len ? range_end - pos : len;
+    n = range_file.read((uint8_t*)out, n);
+    if(n == 0 || pos + n >= range_end)
+    {
+      range_file.close();
     } else {
-      LOGGER_LOG("LOG", "Could not open log file");
+      size_t cut = n;
+      if(range_binary)
+      {
+        cut = record_cut((const uint8_t*)out, n);
+      } else {
+        while(cut > 0 && out[cut - 1] != '\n') { cut--; }
+      }
+      if(cut > 0 && cut < n)
+      {
+        n = cut;
+        range_file.seek(pos + n);
+      }
     }
   }
+  log_unlock();
+  return n;
 }
 
 /**
- * @brief Set up real time clock
+ * @brief A range is being streamed
  * 
+ * @return true logger_read() has more, or has yet to say it is done
  */
-void setup_rtc()
+bool logger_streaming()
 {
-  struct tm timeinfo;
-  configTime(gmtoffset_sec, daylightoffset_sec, ntp_server.c_str());
-  if(!getLocalTime(&timeinfo))
+  return range_active;
+}
+
+/**
+ * @brief Append the buffer to the day's log file and index, sync when log_sync_s has passed
+ * Lines are dropped if the card will not take them, the file is reopened next time
+ * Caller holds the lock
+ * 
+ */
+void log_write()
+{
+  if(log_len == 0) { return; }
+  uint32_t start = micros();
+  if(r4k_file && (file_day != buf_day || file_binary != buf_binary || file_size + log_len > LOG_FILE_MAX)) { log_close(); }
+  if(!r4k_file) { log_open(buf_day); }
+
+  if(!r4k_file)
   {
-    LOGGER_LOG("LOG", "Failed to obtain time");
-    LOGGER_LOG("LOG", "Using defaults");
+    LOGGER_LOG(LVL_ERROR, "LOG", "Could not open log file");
+  } else if(r4k_file.write((const uint8_t*)log_buffer, log_len) != log_len) {
+    LOGGER_LOG(LVL_ERROR, "LOG", "Log write failed, dropped %lu bytes", (unsigned long)log_len);
+    log_close();
   } else {
-    LOGGER_LOG("LOG", "Got time from " + String(ntp_server));
+    if(index_epoch == 0 || buf_epoch >= index_epoch + LOG_INDEX_S)
+    {
+      log_index_t entry = { buf_epoch, file_size };
+      idx_file.write((const uint8_t*)&entry, sizeof(entry));
+      index_epoch = buf_epoch ? buf_epoch : 1;
+    }
+    file_size += log_len;
+    LOGGER_LOG(LVL_DEBUG, "LOG", "Wrote %lu bytes", (unsigned long)log_len);
+    if(millis() - log_synced >= log_sync_s * 1000)
+    {
+      r4k_file.flush();
+      idx_file.flush();
+      log_synced = millis();
+    }
   }
+  log_len = 0;
+  metrics_sd_write(micros() - start);
 }
 
 /**
- * @brief Get the timestamp object
+ * @brief Open the day's newest log file, or the next one if it is full or the other format
+ * Text and binary files share the numbering, so each N has one index
  * 
- * @return String 
+ * @param day Local day
  */
-String get_timestamp()
+void log_open(uint32_t day)
 {
-  struct tm timeinfo;
-  String timestamp;
-  if(!getLocalTime(&timeinfo))
+  char path[LOG_PATH];
+  const char* ext = buf_binary ? "bin" : "txt";
+  if(!SD.exists(LOG_DIR)) { SD.mkdir(LOG_DIR); }
+
+  uint8_t num = 0;
+  while(num + 1 < LOG_FILES_DAY && log_exists(day, num + 1)) { num++; }
+  log_path(day, num, ext, path, sizeof(path));
+  if(!SD.exists(path) && log_exists(day, num) && num + 1 < LOG_FILES_DAY)
   {
-    LOGGER_LOG("LOG", "Failed to obtain time");
-  } else {
-    char time_c[100];
-    strftime(time_c, 50, "%D %T", &timeinfo);
-    timestamp = String(time_c);
+    log_path(day, ++num, ext, path, sizeof(path));
+  }
+  r4k_file = SD.open(path, FILE_APPEND);
+  if(r4k_file && r4k_file.size() > 0 && r4k_file.size() + log_len > LOG_FILE_MAX && num + 1 < LOG_FILES_DAY)
+  {
+    r4k_file.close();
+    log_path(day, ++num, ext, path, sizeof(path));
+    r4k_file = SD.open(path, FILE_APPEND);
   }
+  if(!r4k_file) { return; }
 
-  return timestamp;
+  LOGGER_LOG(LVL_INFO, "LOG", "Logging to %s", path);
+  log_path(day, num, "idx", path, sizeof(path));
+  idx_file = SD.open(path, FILE_APPEND);
+  file_day = day;
+  file_binary = buf_binary;
+  file_size = r4k_file.size();
+  index_epoch = 0;
+  log_synced = millis();
 }
 
 /**
- * @brief Parse incoming string to csv
+ * @brief Sync and close the log file and its index
  * 
- * @param data 
  */
-String parse_data_sd(String data)
+void log_close()
 {
-  String log_data;
-  std::stringstream ss(data.c_str());
-  std::string segment;
-  std::vector<std::string> seglist;
-  while(std::getline(ss, segment, '+'))
+  if(r4k_file)
+  {
+    r4k_file.flush();
+    r4k_file.close();
+  }
+  if(idx_file)
   {
-      seglist.push_back(segment);
+    idx_file.flush();
+    idx_file.close();
   }
+}
+
+/**
+ * @brief Log file path, /log/YYYYMMDD_N.ext
+ * 
+ * @param day Local day
+ * @param num File of the day
+ * @param ext 
+ * @param out 
+ * @param len size of out
+ */
+void log_path(uint32_t day, uint8_t num, const char* ext, char* out, size_t len)
+{
+  struct tm date;
+  time_t start = (time_t)day * 86400;
+  gmtime_r(&start, &date);
+  snprintf(out, len, LOG_DIR "/%04d%02d%02d_%u.%s", date.tm_year + 1900, date.tm_mon + 1, date.tm_mday, (unsigned)num, ext);
+}
+
+/**
+ * @brief A text or binary log file exists
+ * 
+ * @param day Local day
+ * @param num File of the day
+ * @return true 
+ */
+bool log_exists(uint32_t day, uint8_t num)
+{
+  char path[LOG_PATH];
+  log_path(day, num, "txt", path, sizeof(path));
+  if(SD.exists(path)) { return true; }
+  log_path(day, num, "bin", path, sizeof(path));
+  return SD.exists(path);
+}
 
-  uint16_t size = seglist.size();
-  for(int x = 0; x < size; x++)
+/**
+ * @brief Open the next log file holding part of the range, seeked to where it starts
+ * Caller holds the lock
+ * 
+ * @return true range_file is open
+ */
+bool range_open()
+{
+  char path[LOG_PATH];
+  while(range_day <= range_last)
   {
-      if (x == size-1) {
-          log_data += String(seglist[x].c_str());
-      } else {
-          log_data += String(seglist[x].c_str()) + ", ";
+    if(range_num >= LOG_FILES_DAY || !log_exists(range_day, range_num))
+    {
+      range_day++;
+      range_num = 0;
+      continue;
+    }
+    log_path(range_day, range_num, "bin", path, sizeof(path));
+    range_binary = SD.exists(path);
+    if(!range_binary) { log_path(range_day, range_num, "txt", path, sizeof(path)); }
+
+    File file = SD.open(path, FILE_READ);
+    log_path(range_day, range_num, "idx", path, sizeof(path));
+    File idx = SD.open(path, FILE_READ);
+    range_num++;
+    if(!file) { continue; }
+
+    /** Lines before an entry are no newer than it, lines after no older */
+    uint32_t start = 0;
+    uint32_t end = file.size();
+    if(idx)
+    {
+      uint32_t count = idx.size() / sizeof(log_index_t);
+      log_index_t entry;
+      uint32_t first = index_search(idx, count, range_from, true);
+      if(first > 0)
+      {
+        idx.seek((first - 1) * sizeof(entry));
+        idx.read((uint8_t*)&entry, sizeof(entry));
+        start = entry.offset;
       }
+      uint32_t last = index_search(idx, count, range_to, false);
+      if(last < count)
+      {
+        idx.seek(last * sizeof(entry));
+        idx.read((uint8_t*)&entry, sizeof(entry));
+        end = entry.offset;
+      }
+      idx.close();
+    }
+
+    if(start < end)
+    {
+      file.seek(start);
+      range_file = file;
+      range_end = end;
+      return true;
+    }
+    file.close();
   }
+  return false;
+}
 
-  return log_data;
+/**
+ * @brief Binary search an index
+ * 
+ * @param idx 
+ * @param count Entries
+ * @param epoch 
+ * @param equal Find the first entry at or after epoch, else the first after it
+ * @return uint32_t Entry, count for none
+ */
+uint32_t index_search(File& idx, uint32_t count, uint32_t epoch, bool equal)
+{
+  uint32_t low = 0;
+  uint32_t high = count;
+  while(low < high)
+  {
+    uint32_t mid = low + (high - low) / 2;
+    log_index_t entry;
+    idx.seek(mid * sizeof(entry));
+    idx.read((uint8_t*)&entry, sizeof(entry));
+    if(entry.epoch > epoch || (equal && entry.epoch == epoch))
+    {
+      high = mid;
+    } else {
+      low = mid + 1;
+    }
+  }
+  return low;
+}
+
+void log_lock()
+{
+  #ifdef ESP32
+  if(log_mutex != nullptr) { xSemaphoreTake(log_mutex, portMAX_DELAY); }
+  #endif
+}
+
+void log_unlock()
+{
+  #ifdef ESP32
+  if(log_mutex != nullptr) { xSemaphoreGive(log_mutex); }
+  #endif
+}
+
+/**
+ * @brief Set up real time clock
+ * NTP syncs in the background, readings before it are marked unset
+ * 
+ */
+void setup_rtc()
+{
+  clock_setup(gmtoffset_sec, daylightoffset_sec, ntp_server.c_str());
+}
+
+/**
+ * @brief Format a measurement time as local "%D %T"
+ * Uses the configured offsets, so it never waits on the clock
+ * 
+ * @param epoch Measurement time, 0 when the clock was not set
+ * @param out 
+ * @param len size of out
+ * @return size_t Characters written, 0 for an unset time
+ */
+size_t format_timestamp(uint32_t epoch, char* out, size_t len)
+{
+  out[0] = '\0';
+  if(epoch == 0) { return 0; }
+
+  struct tm timeinfo;
+  time_t local = local_time(epoch);
+  gmtime_r(&local, &timeinfo);
+  return strftime(out, len, "%D %T", &timeinfo);
+}
+
+/**
+ * @brief Binary log record of a reading, layout in logger.h
+ * 
+ * @param reading 
+ * @param out LOG_REC_HEADER + READING_MAX * 4 + 2 bytes
+ * @return size_t Record length
+ */
+size_t format_record(const reading_t& reading, uint8_t* out)
+{
+  uint8_t count = reading.count < READING_MAX ? reading.count : READING_MAX;
+  out[0] = LOG_REC_SYNC;
+  out[1] = reading.addr;
+  out[2] = count;
+  out[3] = reading.truncated > 0 ? LOG_REC_TRUNC : 0;
+  memcpy(out + 4, &reading.time, sizeof(reading.time));
+  memcpy(out + LOG_REC_HEADER, reading.values, count * sizeof(float));
+  size_t len = LOG_REC_HEADER + count * sizeof(float);
+  uint16_t crc = crc16(out, len);
+  memcpy(out + len, &crc, sizeof(crc));
+  return len + sizeof(crc);
+}
+
+/**
+ * @brief Length of the whole records at the start of data
+ * 
+ * @param data 
+ * @param len 
+ * @return size_t 0 if the first record is cut off or not a record
+ */
+size_t record_cut(const uint8_t* data, size_t len)
+{
+  size_t pos = 0;
+  while(pos + LOG_REC_HEADER <= len && data[pos] == LOG_REC_SYNC)
+  {
+    size_t rec = LOG_REC_HEADER + data[pos + 2] * sizeof(float) + sizeof(uint16_t);
+    if(pos + rec > len) { break; }
+    pos += rec;
+  }
+  return pos;
+}
+
+/**
+ * @brief Epoch seconds shifted by the configured GMT/DST offsets
+ * 
+ * @param epoch 
+ * @return time_t 
+ */
+time_t local_time(uint32_t epoch)
+{
+  return (time_t)epoch + gmtoffset_sec + daylightoffset_sec;
 }
 
 /**
- * @brief Debug output text
+ * @brief Local day a time falls on, days since 1970-01-01
  * 
- * @param chan Output channel
- * @param data String to output
+ * @param epoch 
+ * @return uint32_t 0 for an unset time
  */
-void LOGGER_LOG(String chan, String data)
+uint32_t local_day(uint32_t epoch)
 {
-    #if LOGGER_DEBUG
-    String disp = "["+chan+"] " + data;
-    Serial.println(disp);
-    #endif
+  return epoch ? local_time(epoch) / 86400 : 0;
 }
@@ -11,6 +11,23 @@
 #ifndef __logger_H__
 #define __logger_H__
 
+#include <reading.h>
+
+/**
+ * Binary log record, CMD 12, little endian, decoder in native/log_decode.py
+ *
+ *   u8      LOG_REC_SYNC
+ *   u8      SDI-12 address
+ *   u8      value count
+ *   u8      flags, LOG_REC_TRUNC values past READING_MAX were left out
+ *   u32     epoch seconds, 0 before the clock was set
+ *   f32     values, count of them
+ *   u16     CRC-16 of everything before it, crc16.h
+ */
+#define LOG_REC_SYNC 0xA5
+#define LOG_REC_HEADER 8
+#define LOG_REC_TRUNC 0x01
+
 /**
  * @brief LOGGER Lib
  * 
@@ -19,11 +36,19 @@ class LOGGER
 {
     public:
     void logger_setup();
-    void write_sd(String data);
+    void logger_loop();
+    void write_sd(const reading_t& reading);
 };
 
+void logger_shutdown();
+bool logger_range(uint32_t from, uint32_t to);
+size_t logger_read(char* out, size_t len);
+bool logger_streaming();
+
 /** Overloads for logic */
 extern bool use_log;
+extern bool log_binary;
+extern uint32_t log_sync_s;
 extern int32_t gmtoffset_sec;
 extern uint32_t daylightoffset_sec;
 
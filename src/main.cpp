@@ -10,51 +10,111 @@
  */
 
 #include <Arduino.h>
-#include <RAK13010_SDI12.h>
 #include <MQTT.h>
-#include <vector>
-#include <map>
-#include <sstream>
 #include <Preferences.h>
 #include <logger.h>
-
-/** Pin setup 
- * SDI-12 data bus, TX
- * SDI-12 data bus, RX
- * Output enable
-*/
-#define TX_PIN WB_IO6
-#define RX_PIN WB_IO5
-#define OE     WB_IO4
-/** Turn on/off debug output */
-#define DEBUG 1
-
-/** RAK SDI-12 Lib */
-RAK_SDI12 sdi12_bus(RX_PIN, TX_PIN, OE);
+#include <sdi.h>
+#include <store.h>
+#include <spsc.h>
+#include <bench.h>
+#include <clock.h>
+#include <metrics.h>
+#include <debug.h>
+#include <esp_attr.h>
+#include <esp_timer.h>
+#include <esp_sleep.h>
+#include <algorithm>
+
+/** Print benchmark JSON lines, set by env:bench */
+#ifndef BENCH
+#define BENCH 0
+#endif
+/** Run acquisition, uplink and SD logging as FreeRTOS tasks, ESP32 only */
+#ifndef SDI_TASKS
+#ifdef ESP32
+#define SDI_TASKS 1
+#else
+#define SDI_TASKS 0
+#endif
+#endif
+/** Readings buffered between acquisition and each consumer */
+#define READING_QUEUE 32
+/** Most time acquisition waits on a full queue before dropping the reading, ms */
+#define READING_WAIT_MS 20
+/** Reading rate sample, for how long the uplink queue lasts, ms */
+#define QUEUE_RATE_MS 10000
+/** Shortest broker connect window, a second a stage, so a busy bus can't keep the uplink down */
+#define QUEUE_WINDOW_MIN_MS 3000
+/** Task stacks, bytes, TLS needs the most */
+#define SDI_STACK 8192
+#define UPLINK_STACK 12288
+#define LOG_STACK 6144
+/** Deep sleep: most time awake for the uplink before giving up on it, ms */
+#define SLEEP_UPLINK_MS 20000
+/** Deep sleep: time connected for retained downlinks to come in, ms */
+#define SLEEP_LISTEN_MS 1000
+/** Deep sleep: shortest sleep, micros */
+#define SLEEP_MIN_US 1000000
+
+/** SDI-12 Lib */
+SDI sdi_lib;
 /** MQTT Lib */
 MQTT mqtt_lib;
 /** Logger Lib */
 LOGGER logger_lib;
 /** Preferences instance */
 Preferences flash_storage;
+/** Per-sensor settings, apart from the config flags so no sensor ID can name one */
+Preferences sensor_storage;
 /** Wait period between sensor readings */
 uint64_t delay_time;
-/** Is the SDI-12 bus ready */
-bool sdi_ready = true;
-/** Number of online sensors */
-uint8_t num_sensors;
-/** Cache of online sensor addresses */
-std::vector<String> addr_cache;
-/** Lookup for current sensors data set i.e D0-D9 */
-std::map<String, uint32_t> data_set;
+/** Worst case loop() time since last report, micros */
+uint32_t loop_max;
+/** Readings on their way to MQTT */
+SPSC<reading_t, READING_QUEUE> uplink_queue;
+/** Readings on their way to the SD log */
+SPSC<reading_t, READING_QUEUE> log_queue;
+/** Readings handed over by acquisition */
+std::atomic<uint32_t> readings_in{0};
+/** Cycles finished, uplink flushes its batch when this moves */
+std::atomic<uint32_t> uplink_cycles{0};
+/** Start a cycle as soon as the bus is idle, set at boot */
+bool cycle_now;
+/** Deep sleep between cycles */
+bool deep_sleep = false;
+/** Last acquisition pass, micros */
+uint32_t loop_last;
+/** Last cycle start, micros */
+uint32_t cycle_last;
+/** Cycles finished at boot, and boot time, millis */
+uint32_t wake_cycles;
+uint32_t wake_ms;
+/** Deep sleep: next cycle, micros since boot */
+uint64_t cycle_due_us;
+/** Deep sleep: woke for scheduled sensors, the cycle isn't due yet */
+bool sched_wake;
+/** Deep sleep: cycle time left after the sleep, micros, 0 to measure on wake */
+RTC_DATA_ATTR uint64_t rtc_cycle_us = 0;
+#if SDI_TASKS
+/** Held by whoever is touching the SDI-12 engine */
+SemaphoreHandle_t sdi_mutex;
+#endif
 
 /** Forward declaration */
-void R_LOG(String chan, String data);
-bool is_online(String addr);
-void cache_online();
-void sdi_measure();
-void set_lookup(String addr);
-String strip_addr(String data);
+void acquire_step();
+void uplink_step(uint32_t window_ms);
+void log_step();
+void sleep_step(uint32_t cycles);
+void sleep_now();
+bool reading_push(SPSC<reading_t, READING_QUEUE>& queue, const reading_t& reading, const char* to);
+#if SDI_TASKS
+void sdi_task(void* arg);
+void uplink_task(void* arg);
+void log_task(void* arg);
+uint32_t queue_window_ms();
+#else
+uint32_t bus_window_ms();
+#endif
 
 /**
  * @brief Setup firmware
@@ -76,20 +136,60 @@ void setup()
             break;
         }
     }
+    esp_register_shutdown_handler(debug_drain);
 
     /** Initialize flash storage */
-    R_LOG("FLASH", "Starting flash storage");
+    R_LOG(LVL_DEBUG, "FLASH", "Starting flash storage");
     flash_storage.begin("SDI12", false);
+    sensor_storage.begin("SDI12sensors", false);
     delay_time = flash_storage.getULong64("period", 15000000);
-    R_LOG("FLASH", "Read: Delay time " + String(delay_time));
+    R_LOG(LVL_DEBUG, "FLASH", "Read: Delay time %llu", (unsigned long long)delay_time);
     CSV = flash_storage.getBool("csv", true);
-    R_LOG("FLASH", "Read: CSV " + String(CSV));
+    R_LOG(LVL_DEBUG, "FLASH", "Read: CSV %d", CSV);
+    BATCH = flash_storage.getBool("batch", false);
+    R_LOG(LVL_DEBUG, "FLASH", "Read: Batch %d", BATCH);
+    PACKED = flash_storage.getBool("packed", false);
+    R_LOG(LVL_DEBUG, "FLASH", "Read: Packed %d", PACKED);
+    concurrent = flash_storage.getBool("conc", false);
+    R_LOG(LVL_DEBUG, "FLASH", "Read: Concurrent %d", concurrent);
+    use_crc = flash_storage.getBool("crc", false);
+    R_LOG(LVL_DEBUG, "FLASH", "Read: CRC %d", use_crc);
+    fast_ms = flash_storage.getUInt("fast", 1000);
+    R_LOG(LVL_DEBUG, "FLASH", "Read: Continuous period %lu", (unsigned long)fast_ms);
+    single_sensor = flash_storage.getBool("single", false);
+    R_LOG(LVL_DEBUG, "FLASH", "Read: Single sensor %d", single_sensor);
     use_sd = flash_storage.getBool("sd", false);
-    R_LOG("FLASH", "Read: SD " + String(use_sd));
+    R_LOG(LVL_DEBUG, "FLASH", "Read: SD %d", use_sd);
+    log_sync_s = flash_storage.getUInt("fsync", 60);
+    R_LOG(LVL_DEBUG, "FLASH", "Read: SD sync %lu", (unsigned long)log_sync_s);
+    log_binary = flash_storage.getBool("sdbin", false);
+    R_LOG(LVL_DEBUG, "FLASH", "Read: SD binary %d", log_binary);
     gmtoffset_sec = flash_storage.getInt("gmt", -12600);
-    R_LOG("FLASH", "Read: GMT " + String(gmtoffset_sec));
+    R_LOG(LVL_DEBUG, "FLASH", "Read: GMT %ld", (long)gmtoffset_sec);
     daylightoffset_sec = flash_storage.getUInt("dst", 3600);
-    R_LOG("FLASH", "Read: DST " + String(daylightoffset_sec));
+    R_LOG(LVL_DEBUG, "FLASH", "Read: DST %lu", (unsigned long)daylightoffset_sec);
+    deep_sleep = flash_storage.getBool("sleep", false);
+    R_LOG(LVL_DEBUG, "FLASH", "Read: Deep sleep %d", deep_sleep);
+    metrics_period_s = flash_storage.getUInt("metrics", METRICS_PERIOD_S);
+    R_LOG(LVL_DEBUG, "FLASH", "Read: Metrics %lu", (unsigned long)metrics_period_s);
+    cycle_now = true;
+    sched_wake = false;
+    cycle_due_us = delay_time;
+    if(esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER)
+    {
+        R_LOG(LVL_INFO, "SLEEP", "Woke from deep sleep");
+        if(rtc_cycle_us > 0)
+        {
+            R_LOG(LVL_INFO, "SLEEP", "Scheduled sensors only, cycle in %lums", (unsigned long)(rtc_cycle_us / 1000));
+            cycle_now = false;
+            sched_wake = true;
+            cycle_due_us = rtc_cycle_us;
+        }
+    }
+    rtc_cycle_us = 0;
+    loop_last = micros();
+    wake_cycles = uplink_cycles.load();
+    wake_ms = millis();
 
     /** 
      * Join WiFi and connect to MQTT 
@@ -98,240 +198,350 @@ void setup()
      */
     mqtt_lib.mqtt_setup();
     logger_lib.logger_setup();
+    store_setup();
+    sdi_lib.sdi_setup();
+
+    #if BENCH
+    static bench_parse_t legacy, current;
+    static char json[BENCH_JSON];
+    bench_parse(BENCH_PARSE_ITER, legacy, current);
+    bench_json(nullptr, &legacy, &current, json, sizeof(json));
+    Serial.println(json);
+    bench_start();
+    #endif
 
-    R_LOG("SDI-12", "Starting bus");
-    sdi12_bus.begin();
-    delay(500);
-
-    sdi12_bus.forceListen();
-    cache_online();
+    /** 
+     * SDI-12 bit banging gets the app core to itself,
+     * TLS and SD share the core WiFi runs on
+     * 
+     */
+    #if SDI_TASKS
+    sdi_mutex = xSemaphoreCreateMutex();
+    xTaskCreatePinnedToCore(sdi_task, "sdi", SDI_STACK, nullptr, 3, nullptr, APP_CPU_NUM);
+    xTaskCreatePinnedToCore(uplink_task, "uplink", UPLINK_STACK, nullptr, 2, nullptr, PRO_CPU_NUM);
+    xTaskCreatePinnedToCore(log_task, "log", LOG_STACK, nullptr, 1, nullptr, PRO_CPU_NUM);
+    #endif
 }
 
 /**
  * @brief Firmwares main loop
- * Run periodic measure
+ * With tasks it has nothing left to do, otherwise step
+ * acquisition, uplink and SD logging in turn
  * 
  */
 void loop() 
 {
-    /** Loop our MQTT lib */
-    mqtt_lib.mqtt_loop();
-    /** Measure every X seconds if SDI-12 bus is ready */
-    static uint32_t last_time;
-    if ((micros() - last_time) >= delay_time && sdi_ready)
-    {
-        last_time = micros();
-        /** SD card logic */
-        use_log = give_up;
-        sdi_measure();
-    }
+    #if SDI_TASKS
+    vTaskDelete(nullptr);
+    #else
+    acquire_step();
+    /** Broker connects and queue draining wait for the bus to be idle, a connect has to fit before its next read */
+    uplink_step(bus_window_ms());
+    log_step();
+    #endif
 }
 
 /**
- * @brief Poll SDI-12 sensor for data
- * Measure: [a]M! - prepares sensor for reading and returns reading info
- * Data: [a]D[0-9]! - Ask sensor for all data values
+ * @brief Step the SDI-12 bus, run periodic measure
+ * Nothing in here blocks, so track the worst case pass
  * 
  */
-void sdi_measure()
+void acquire_step()
 {
-    sdi_ready = false;
-    static String sdi_response;
-    for(int x = 0; x < num_sensors; x++)
+    uint32_t loop_start = micros();
+    metrics_loop(loop_start - loop_last);
+    loop_last = loop_start;
+    sdi_lock();
+    /** Woke for scheduled sensors, they are this wake's cycle, ahead of sdi_loop() reading them between cycles */
+    if(sched_wake && sdi_lib.sdi_idle())
     {
-        sdi_response = "";
-        sdi12_bus.sendCommand(addr_cache[x] + "M!");
-        R_LOG("SDI-12", "Sent: " + addr_cache[x] + "M!");
-        delay(100);
-
-        sdi_response = sdi12_bus.readString();
-        sdi_response.trim();
-        R_LOG("SDI-12", "Reply: " + sdi_response);
-        uint8_t wait = sdi_response.substring(1, 4).toInt();
-        /** Added 1 second padding */
-        uint32_t wait_ms = (wait+1)*1000;
-        R_LOG("SDI-12", "Pausing for: " + String(wait+1));
-        delay(wait_ms);
-
-        uint32_t ds_amt = data_set[addr_cache[x]];
-        String mqtt_splice;
-
-        for(int y = 0; y <= ds_amt; y++)
+        uint64_t sched_us = sdi_lib.sdi_sched_us();
+        if(sched_us == 0)
         {
-            sdi_response = "";
-            sdi12_bus.sendCommand(addr_cache[x] + "D" + String(y) + "!");
-            R_LOG("SDI-12", "Sent: " + addr_cache[x] + "D" + String(y) + "!");
-            delay(100);
-
-            /** Drop first byte, sensor ready reply */
-            if(y == 0) { sdi12_bus.read(); }
-            sdi_response = sdi12_bus.readString();
-            sdi_response.trim();
-            sdi_response = strip_addr(sdi_response);
-            R_LOG("SDI-12", "Reply: " + sdi_response);
-            if(y != ds_amt)
-            {
-                mqtt_splice += sdi_response + "+";
-            } else {
-                 mqtt_splice += sdi_response;
-            }
-            sdi12_bus.clearBuffer();
+            sched_wake = false;
+            use_log = offline;
+            sdi_lib.sdi_measure(false);
+        } else if(sched_us > SLEEP_UPLINK_MS * 1000ULL) {
+            /** Schedule changed since the sleep, nothing to wait for */
+            sched_wake = false;
+            cycle_now = true;
+            cycle_due_us = delay_time;
         }
-        mqtt_lib.mqtt_publish(addr_cache[x], mqtt_splice);
-        logger_lib.write_sd(mqtt_splice);
     }
-    sdi_ready = true;   
+    /** Step SDI-12 bus */
+    sdi_lib.sdi_loop();
+    /** Measure every X seconds if SDI-12 bus is ready, first cycle right away */
+    if ((cycle_now || (micros() - cycle_last) >= delay_time) && sdi_lib.sdi_idle())
+    {
+        cycle_now = false;
+        cycle_last = micros();
+        R_LOG(LVL_INFO, "LOOP", "Max loop: %luus, bus TX: %luus, queued: %lu, dropped: %lu", (unsigned long)loop_max,
+            (unsigned long)bus_tx_max, (unsigned long)store_depth(), (unsigned long)(uplink_queue.drops + log_queue.drops));
+        loop_max = 0;
+        bus_tx_max = 0;
+        /** SD card logic */
+        use_log = offline;
+        sdi_lib.sdi_measure(true);
+    }
+    /** Serial output goes out as the UART has room, never waits on it */
+    debug_flush();
+    sdi_unlock();
+
+    uint32_t took = micros() - loop_start;
+    if(took > loop_max) { loop_max = took; }
+
+    #if BENCH
+    if(bench_loop(took))
+    {
+        static char json[BENCH_JSON];
+        bench_json(&bench_result(), nullptr, nullptr, json, sizeof(json));
+        Serial.println(json);
+    }
+    #endif
 }
 
 /**
- * @brief Strip SDI-12 address from reply
+ * @brief Publish readings from acquisition, keep the broker session up
+ * The cycle count is read before the queue is emptied, so a batch
+ * flush always has its whole cycle in
  * 
- * @param data 
- * @return String 
+ * @param window_ms Time a blocking broker connect can take from the bus, 0 for no
+ * connect or queue drain
  */
-String strip_addr(String data)
+void uplink_step(uint32_t window_ms)
 {
-    std::stringstream ss(data.c_str());
-    std::string segment;
-    std::vector<std::string> seglist;
-    String stripped;
-    while(std::getline(ss, segment, '+'))
+    static reading_t reading;
+    static uint32_t flushed;
+    uint32_t cycles = uplink_cycles.load(std::memory_order_acquire);
+    while(uplink_queue.pop(reading)) { mqtt_lib.mqtt_publish(reading); }
+    if(cycles != flushed)
     {
-        seglist.push_back(segment);
+        flushed = cycles;
+        mqtt_lib.mqtt_flush();
     }
 
-    uint16_t size = seglist.size();
-    for(int x = 0; x < size; x++)
-    {
-        if(x == 0)
-        {
-            /** Drop first segment as it's the sensors address */
-        } else if (x == size-1) {
-            stripped += String(seglist[x].c_str());
-        } else {
-            stripped += String(seglist[x].c_str()) + "+";
-        }
-    }
+    mqtt_lib.mqtt_loop(window_ms);
+    if(window_ms > 0) { mqtt_lib.mqtt_drain(); }
+    sleep_step(cycles);
+}
+
+/**
+ * @brief Write readings from acquisition to the SD log
+ * 
+ */
+void log_step()
+{
+    static reading_t reading;
+    while(log_queue.pop(reading)) { logger_lib.write_sd(reading); }
+    logger_lib.logger_loop();
+}
 
-    return stripped;
+/**
+ * @brief Deep sleep once this wake's cycle is out, see CMD 13
+ * Waits for the queue to publish and retained downlinks to come in,
+ * after SLEEP_UPLINK_MS what is left waits on SD or in RTC memory
+ * 
+ * @param cycles Cycles finished and flushed
+ */
+void sleep_step(uint32_t cycles)
+{
+    if(!deep_sleep || cycles == wake_cycles) { return; }
+    if(uplink_queue.depth() > 0 || log_queue.depth() > 0) { return; }
+    bool sent = mqtt_lib.mqtt_connected_ms() >= SLEEP_LISTEN_MS && store_depth() == 0 && !logger_streaming();
+    if(!sent && millis() - wake_ms < SLEEP_UPLINK_MS) { return; }
+
+    sdi_lock();
+    if(sdi_lib.sdi_idle()) { sleep_now(); }
+    sdi_unlock();
+}
+
+/**
+ * @brief Put everything away and deep sleep until the next cycle or scheduled sensor is due
+ * The cycle is delay_time from a cycle wake, boot included. A scheduled
+ * sensor due first wakes early, the cycle time left is kept for that wake
+ * 
+ */
+void sleep_now()
+{
+    uint64_t awake = esp_timer_get_time();
+    uint64_t cycle_us = cycle_due_us > awake ? cycle_due_us - awake : 0;
+    uint64_t sleep_us = std::min(cycle_us, sdi_lib.sdi_sched_us());
+    if(sleep_us < SLEEP_MIN_US) { sleep_us = SLEEP_MIN_US; }
+    /** A cycle due within a wake of this one is taken with it */
+    rtc_cycle_us = cycle_us > sleep_us + SLEEP_MIN_US ? cycle_us - sleep_us : 0;
+    R_LOG(LVL_INFO, "SLEEP", "Awake %lums, sleeping %lums", (unsigned long)(awake / 1000), (unsigned long)(sleep_us / 1000));
+    /** Metrics go out every wake, the counts don't survive the sleep */
+    if(metrics_period_s > 0) { mqtt_lib.mqtt_metrics(); }
+    mqtt_lib.mqtt_sleep();
+    logger_shutdown();
+    store_sleep();
+    sdi_lib.sdi_sleep();
+    clock_sleep();
+    debug_drain();
+    esp_sleep_enable_timer_wakeup(sleep_us);
+    esp_deep_sleep_start();
 }
 
+#if SDI_TASKS
 /**
- * @brief Cache all online SDI-12 sensor addresses
- * Info: [a]I! - Returns information about the sensor
+ * @brief SDI-12 acquisition task, pinned to the app core
+ * Yields a tick per pass, replies buffer in the driver meanwhile
  * 
+ * @param arg 
  */
-void cache_online()
+void sdi_task(void* arg)
 {
-    addr_cache.clear();
-    sdi_ready = false;
-    for(int x = 0; x <= 9; x++)
+    while(true)
     {
-        if(is_online(String(x)))
-        {
-            R_LOG("SDI-12", "Address cached: " + String(x));
-            addr_cache.push_back(String(x));
-            set_lookup(String(x));
-        }
+        acquire_step();
+        vTaskDelay(1);
     }
+}
 
-    for (char y = 'a'; y <= 'z'; y++)
+/**
+ * @brief MQTT/TLS task, on the WiFi core
+ * Blocking here never holds up the bus, but nothing leaves the queue
+ * meanwhile, so a broker connect gets what the queue has room for
+ * 
+ * @param arg 
+ */
+void uplink_task(void* arg)
+{
+    while(true)
     {
-        if(is_online(String(y)))
-        {
-            R_LOG("SDI-12", "Address cached: " + String(y));
-            addr_cache.push_back(String(y));
-            set_lookup(String(y));
-        }
+        uplink_step(queue_window_ms());
+        vTaskDelay(pdMS_TO_TICKS(10));
     }
+}
 
-    for (char z = 'A'; z <= 'Z'; z++)
+/**
+ * @brief SD logging task
+ * 
+ * @param arg 
+ */
+void log_task(void* arg)
+{
+    while(true)
     {
-        if(is_online(String(z)))
-        {
-            R_LOG("SDI-12", "Address cached: " + String(z));
-            addr_cache.push_back(String(z));
-            set_lookup(String(z));
-        }
+        log_step();
+        vTaskDelay(pdMS_TO_TICKS(50));
     }
-
-    num_sensors = addr_cache.size();
-    sdi_ready = true; 
 }
 
 /**
- * @brief Sends a basic ack command and if it gets a reply
- * the SDI-12 sensor at that address is confirmed online
+ * @brief Time before acquisition fills the uplink queue
+ * At the rate of the last QUEUE_RATE_MS, or of the sample under way if
+ * that is faster, halved since readings come in bursts
  * 
- * Sends basic acknowledge command [a][!]
+ * @return uint32_t ms, QUEUE_WINDOW_MIN_MS at least, UINT32_MAX before any reading
+ */
+uint32_t queue_window_ms()
+{
+    static uint32_t rate_ms;
+    static uint32_t rate_readings;
+    static uint32_t last_per_min;
+    uint32_t now = millis();
+    uint32_t readings = readings_in.load(std::memory_order_relaxed);
+    uint32_t elapsed = std::max<uint32_t>(now - rate_ms, 1000);
+    uint32_t per_min = (uint64_t)(readings - rate_readings) * 60000 / elapsed;
+    if(now - rate_ms >= QUEUE_RATE_MS)
+    {
+        last_per_min = per_min;
+        rate_ms = now;
+        rate_readings = readings;
+    }
+    per_min = std::max(per_min, last_per_min);
+    if(per_min == 0) { return UINT32_MAX; }
+
+    uint32_t room = READING_QUEUE - 1 - uplink_queue.depth();
+    uint64_t window_ms = (uint64_t)room * 60000 / per_min / 2;
+    return std::max<uint64_t>(window_ms, QUEUE_WINDOW_MIN_MS);
+}
+#else
+/**
+ * @brief Bus time free before the next cycle or scheduled read
+ * Without tasks a broker connect blocks the bus, it has to fit in here.
+ * Continuous reads are left out, they'd leave no room at short CMD 17
+ * periods, a read due during a connect goes out once it's done
  * 
- * @param addr 
- * @return true SDI-12 sensor found
- * @return false SDI-12 not sensor found
+ * @return uint32_t ms, 0 while the bus is busy or a cycle is due
  */
-bool is_online(String addr)
+uint32_t bus_window_ms()
 {
-    bool found = false;
+    if(!sdi_lib.sdi_idle() || cycle_now || sched_wake) { return 0; }
+    uint64_t since = micros() - cycle_last;
+    uint64_t window_us = delay_time > since ? delay_time - since : 0;
+    window_us = std::min(window_us, sdi_lib.sdi_sched_us());
+    return std::min<uint64_t>(window_us / 1000, UINT32_MAX);
+}
+#endif
 
-    for(int x = 0; x < 3; x++)
-    {
-        sdi12_bus.sendCommand(addr + "!");
-        R_LOG("SDI-12", "Sent: " + addr + "!");
-        delay(100);
+/**
+ * @brief Hold the SDI-12 engine, i.e while a downlink changes its config
+ * 
+ */
+void sdi_lock()
+{
+    #if SDI_TASKS
+    xSemaphoreTake(sdi_mutex, portMAX_DELAY);
+    #endif
+}
 
-        uint16_t avail = sdi12_bus.available();
-        if(avail > 0)
-        {
-            R_LOG("SDI-12", "Sensor found on: " + addr);
-            sdi12_bus.clearBuffer();
-            found = true;
-            return true;
-        } else {
-            R_LOG("SDI-12", "No sensor found on: " + addr);
-            sdi12_bus.clearBuffer();
-            found = false;
-        }
-    }
+/**
+ * @brief Release the SDI-12 engine
+ * 
+ */
+void sdi_unlock()
+{
+    #if SDI_TASKS
+    xSemaphoreGive(sdi_mutex);
+    #endif
+}
 
-    return found;
+/**
+ * @brief Completed sensor reading
+ * Hand it to uplink and the SD log, waits READING_WAIT_MS at most on either
+ * 
+ * @param reading 
+ */
+void sdi_reading(const reading_t& reading)
+{
+    readings_in.fetch_add(1, std::memory_order_relaxed);
+    reading_push(uplink_queue, reading, "Uplink");
+    if(use_sd) { reading_push(log_queue, reading, "Log"); }
 }
 
 /**
- * @brief Poll sensor for data set info
+ * @brief Queue a reading, with tasks wait for the consumer to make room
+ * A reading that still doesn't fit is dropped, counted in metrics
  * 
- * @param addr 
+ * @param queue 
+ * @param reading 
+ * @param to Queue name for the log
+ * @return true Queued
  */
-void set_lookup(String addr)
+bool reading_push(SPSC<reading_t, READING_QUEUE>& queue, const reading_t& reading, const char* to)
 {
-    data_set.clear();
-    static String sdi_response;
-    sdi_response = "";
-    sdi12_bus.sendCommand(addr + "I!");
-    R_LOG("SDI-12", "Sent: " + addr + "I!");
-    delay(100);
-
-    sdi_response = sdi12_bus.readString();
-    sdi_response.trim();
-    uint16_t sensor_id = sdi_response.substring(20).toInt();
-    R_LOG("SDI-12", "Reply: " + String(sensor_id));
-    R_LOG("FLASH", "Read: Data set " + String(sensor_id));
-    data_set.insert({addr, flash_storage.getUInt(std::to_string(sensor_id).c_str(), 0)});
+    #if SDI_TASKS
+    for(uint32_t wait = 0; wait < READING_WAIT_MS && queue.depth() >= READING_QUEUE - 1; wait++)
+    {
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    #endif
+    if(queue.push(reading)) { return true; }
+    metrics_queue_drop();
+    R_LOG(LVL_WARN, "QUEUE", "%s queue full, reading from %c dropped", to, reading.addr);
+    return false;
 }
 
 /**
- * @brief Change SDI-12 sensor address
- * and cache online sensor addresses again
+ * @brief Measurement cycle done
+ * Uplink publishes the batch
  * 
- * @param addr_old 
- * @param addr_new 
  */
-void chng_addr(String addr_old, String addr_new)
+void sdi_cycle_done()
 {
-    sdi12_bus.sendCommand(addr_old + "A" + addr_new + "!");
-    R_LOG("SDI-12", "Sent: " + addr_old + "A" + addr_new + "!");
-    delay(100);
-    sdi12_bus.clearBuffer();
-    cache_online();
+    uplink_cycles.fetch_add(1, std::memory_order_release);
 }
 
 /**
@@ -344,8 +554,8 @@ void chng_addr(String addr_old, String addr_new)
 void flash_32(const char* key, int32_t value, bool restart)
 {
     flash_storage.putInt(key, value);
-    R_LOG("FLASH", "Write: " + String(key) + "/" + String(value));
-    if(restart) { cache_online(); }
+    R_LOG(LVL_INFO, "FLASH", "Write: %s/%ld", key, (long)value);
+    if(restart) { cache_lookup(); }
 }
 
 /**
@@ -358,8 +568,8 @@ void flash_32(const char* key, int32_t value, bool restart)
 void flash_32u(const char* key, uint32_t value, bool restart)
 {
     flash_storage.putUInt(key, value);
-    R_LOG("FLASH", "Write: " + String(key) + "/" + String(value));
-    if(restart) { cache_online(); }
+    R_LOG(LVL_INFO, "FLASH", "Write: %s/%lu", key, (unsigned long)value);
+    if(restart) { cache_lookup(); }
 }
 
 /**
@@ -372,8 +582,8 @@ void flash_32u(const char* key, uint32_t value, bool restart)
 void flash_64u(const char* key, uint64_t value, bool restart)
 {
     flash_storage.putULong64(key, value);
-    R_LOG("FLASH", "Write: " + String(key) + "/" + String(value));
-    if(restart) { cache_online(); }
+    R_LOG(LVL_INFO, "FLASH", "Write: %s/%llu", key, (unsigned long long)value);
+    if(restart) { cache_lookup(); }
 }
 
 /**
@@ -386,20 +596,57 @@ void flash_64u(const char* key, uint64_t value, bool restart)
 void flash_bool(const char* key, bool value, bool restart)
 {
     flash_storage.putBool(key, value);
-    R_LOG("FLASH", "Write: " + String(key) + "/" + String(value));
-    if(restart) { cache_online(); }
+    R_LOG(LVL_INFO, "FLASH", "Write: %s/%d", key, value);
+    if(restart) { cache_lookup(); }
 }
 
 /**
- * @brief 
+ * @brief Remove key from flash
  * 
- * @param chan Output channel
- * @param data String to output
+ * @param key char
+ * @param restart restart SDI-12 sensor lookup
  */
-void R_LOG(String chan, String data)
+void flash_remove(const char* key, bool restart)
 {
-    #if DEBUG
-    String disp = "["+chan+"] " + data;
-    Serial.println(disp);
-    #endif
+    flash_storage.remove(key);
+    R_LOG(LVL_INFO, "FLASH", "Remove: %s", key);
+    if(restart) { cache_lookup(); }
+}
+
+/**
+ * @brief Save a per-sensor setting to flash, restarts SDI-12 sensor lookup
+ * 
+ * @param key from sensor_key()
+ * @param value uint32_t
+ */
+void sensor_32u(const char* key, uint32_t value)
+{
+    sensor_storage.putUInt(key, value);
+    R_LOG(LVL_INFO, "FLASH", "Write: sensor %s/%lu", key, (unsigned long)value);
+    cache_lookup();
+}
+
+/**
+ * @brief Save a per-sensor setting to flash, restarts SDI-12 sensor lookup
+ * 
+ * @param key from sensor_key()
+ * @param value uint64_t
+ */
+void sensor_64u(const char* key, uint64_t value)
+{
+    sensor_storage.putULong64(key, value);
+    R_LOG(LVL_INFO, "FLASH", "Write: sensor %s/%llu", key, (unsigned long long)value);
+    cache_lookup();
+}
+
+/**
+ * @brief Remove a per-sensor setting from flash, restarts SDI-12 sensor lookup
+ * 
+ * @param key from sensor_key()
+ */
+void sensor_remove(const char* key)
+{
+    sensor_storage.remove(key);
+    R_LOG(LVL_INFO, "FLASH", "Remove: sensor %s", key);
+    cache_lookup();
 }
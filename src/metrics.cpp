@@ -0,0 +1,252 @@
+/**
+ * @file metrics.cpp
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief Latency histograms and health counters, published on MQTT
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <Arduino.h>
+#include <metrics.h>
+#include <clock.h>
+#include <store.h>
+
+/** Longest sensor entry in a report */
+#define METRICS_ENTRY 512
+/** Room kept for the left out count and closing braces */
+#define METRICS_TAIL 16
+
+/** Figures since the last report */
+metrics_t metrics;
+/** Seconds between reports, 0 for none */
+uint32_t metrics_period_s = METRICS_PERIOD_S;
+
+/** Forward declaration */
+sensor_metrics_t* metrics_sensor(char addr);
+int format_hist(const hist_t& hist, char* out, size_t len);
+
+/**
+ * @brief Count a value
+ *
+ * @param hist
+ * @param value
+ */
+void hist_add(hist_t& hist, uint32_t value)
+{
+    uint8_t bucket = value == 0 ? 0 : 32 - __builtin_clz(value);
+    if(bucket >= METRICS_BUCKETS) { bucket = METRICS_BUCKETS - 1; }
+    hist.buckets[bucket]++;
+    hist.count++;
+    hist.sum += value;
+    if(value > hist.max) { hist.max = value; }
+}
+
+/**
+ * @brief Measure to data ready
+ *
+ * @param addr
+ * @param ms
+ */
+void metrics_ready(char addr, uint32_t ms)
+{
+    sensor_metrics_t* sensor = metrics_sensor(addr);
+    if(sensor) { hist_add(sensor->ready, ms); }
+}
+
+/**
+ * @brief Data command round trip
+ *
+ * @param addr
+ * @param us
+ */
+void metrics_data(char addr, uint32_t us)
+{
+    sensor_metrics_t* sensor = metrics_sensor(addr);
+    if(sensor) { hist_add(sensor->data, us); }
+}
+
+void metrics_timeout(char addr)
+{
+    sensor_metrics_t* sensor = metrics_sensor(addr);
+    if(sensor) { sensor->timeouts++; }
+}
+
+void metrics_parse_fail(char addr)
+{
+    sensor_metrics_t* sensor = metrics_sensor(addr);
+    if(sensor) { sensor->parse_fails++; }
+}
+
+void metrics_crc_fail(char addr)
+{
+    sensor_metrics_t* sensor = metrics_sensor(addr);
+    if(sensor) { sensor->crc_fails++; }
+}
+
+void metrics_retry(char addr)
+{
+    sensor_metrics_t* sensor = metrics_sensor(addr);
+    if(sensor) { sensor->retries++; }
+}
+
+void metrics_truncated(char addr)
+{
+    sensor_metrics_t* sensor = metrics_sensor(addr);
+    if(sensor) { sensor->truncated++; }
+}
+
+/**
+ * @brief One MQTT publish call
+ *
+ * @param us
+ * @param ok The broker took it
+ */
+void metrics_publish(uint32_t us, bool ok)
+{
+    hist_add(metrics.publish, us);
+    if(!ok) { metrics.publish_fails++; }
+}
+
+void metrics_sd_write(uint32_t us)
+{
+    hist_add(metrics.sd_write, us);
+}
+
+void metrics_loop(uint32_t gap_us)
+{
+    hist_add(metrics.loop_gap, gap_us);
+}
+
+void metrics_queue_drop()
+{
+    metrics.queue_drops++;
+}
+
+/**
+ * @brief Format the report as compact JSON
+ * Histograms are [count,sum,max,first bucket,buckets...], empty buckets
+ * at either end left out, see README. Sensors that don't fit are left out
+ * and counted in sx
+ *
+ * @param out
+ * @param len METRICS_JSON
+ * @return size_t report length, 0 if it doesn't fit
+ */
+size_t metrics_format(char* out, size_t len)
+{
+    int n = snprintf(out, len, "{\"t\":%lu,\"up\":%lu,\"s\":%lu,\"heap\":[%lu,%lu],\"loop\":",
+        (unsigned long)get_epoch(), (unsigned long)(millis() / 1000), (unsigned long)((millis() - metrics.since) / 1000),
+        (unsigned long)ESP.getFreeHeap(), (unsigned long)ESP.getMinFreeHeap());
+    if(n < 0 || (size_t)n >= len) { return 0; }
+    n += format_hist(metrics.loop_gap, out + n, len - n);
+    n += snprintf(out + n, len - n, ",\"pub\":");
+    n += format_hist(metrics.publish, out + n, len - n);
+    n += snprintf(out + n, len - n, ",\"pf\":%lu,\"sd\":", (unsigned long)metrics.publish_fails);
+    n += format_hist(metrics.sd_write, out + n, len - n);
+    n += snprintf(out + n, len - n, ",\"clk\":[%lu,%lu,%ld,%lu],\"q\":[%lu,%lu,%lu],\"sdi\":{",
+        (unsigned long)clock_sync.syncs, (unsigned long)clock_sync.last, (long)clock_sync.correction_ms,
+        (unsigned long)clock_sync.worst_ms, (unsigned long)store_depth(), (unsigned long)store_dropped,
+        (unsigned long)metrics.queue_drops);
+    /** Leave room for the left out count and closing braces */
+    if((size_t)n + METRICS_TAIL >= len) { return 0; }
+
+    char entry[METRICS_ENTRY];
+    bool first = true;
+    uint8_t left_out = 0;
+    for(int x = 0; x < METRICS_SENSORS; x++)
+    {
+        const sensor_metrics_t& sensor = metrics.sensors[x];
+        if(sensor.addr == 0) { continue; }
+        if(sensor.ready.count == 0 && sensor.data.count == 0 && sensor.timeouts == 0 &&
+            sensor.parse_fails == 0 && sensor.crc_fails == 0 && sensor.retries == 0 &&
+            sensor.truncated == 0) { continue; }
+
+        int e = snprintf(entry, sizeof(entry), "%s\"%c\":[", first ? "" : ",", sensor.addr);
+        e += format_hist(sensor.ready, entry + e, sizeof(entry) - e);
+        e += snprintf(entry + e, sizeof(entry) - e, ",");
+        e += format_hist(sensor.data, entry + e, sizeof(entry) - e);
+        e += snprintf(entry + e, sizeof(entry) - e, ",%u,%u,%u,%u,%u]",
+            sensor.timeouts, sensor.parse_fails, sensor.crc_fails, sensor.retries, sensor.truncated);
+        if(e >= (int)sizeof(entry) || (size_t)(n + e + METRICS_TAIL) >= len)
+        {
+            left_out++;
+            continue;
+        }
+        memcpy(out + n, entry, e);
+        n += e;
+        first = false;
+    }
+    n += snprintf(out + n, len - n, "},\"sx\":%u}", left_out);
+    return n;
+}
+
+/**
+ * @brief Start a new report, sensors keep their slots
+ *
+ */
+void metrics_reset()
+{
+    for(int x = 0; x < METRICS_SENSORS; x++)
+    {
+        char addr = metrics.sensors[x].addr;
+        memset(&metrics.sensors[x], 0, sizeof(sensor_metrics_t));
+        metrics.sensors[x].addr = addr;
+    }
+    memset(&metrics.publish, 0, sizeof(hist_t));
+    memset(&metrics.sd_write, 0, sizeof(hist_t));
+    memset(&metrics.loop_gap, 0, sizeof(hist_t));
+    metrics.publish_fails = 0;
+    metrics.queue_drops = 0;
+    metrics.since = millis();
+}
+
+/**
+ * @brief Slot for an address, taken on first use
+ *
+ * @param addr
+ * @return sensor_metrics_t* nullptr once every slot is taken
+ */
+sensor_metrics_t* metrics_sensor(char addr)
+{
+    for(int x = 0; x < METRICS_SENSORS; x++)
+    {
+        sensor_metrics_t& sensor = metrics.sensors[x];
+        if(sensor.addr == addr) { return &sensor; }
+        if(sensor.addr == 0)
+        {
+            sensor.addr = addr;
+            return &sensor;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Histogram as [count,sum,max,first,buckets...]
+ *
+ * @param hist
+ * @param out
+ * @param len
+ * @return int length written, never more than len - 1
+ */
+int format_hist(const hist_t& hist, char* out, size_t len)
+{
+    if(len == 0) { return 0; }
+    if(hist.count == 0) { return snprintf(out, len, "%s", len > 3 ? "[0]" : ""); }
+    int lo = 0;
+    int hi = METRICS_BUCKETS - 1;
+    while(lo < hi && hist.buckets[lo] == 0) { lo++; }
+    while(hi > lo && hist.buckets[hi] == 0) { hi--; }
+
+    int n = snprintf(out, len, "[%lu,%lu,%lu,%d", (unsigned long)hist.count, (unsigned long)hist.sum,
+        (unsigned long)hist.max, lo);
+    for(int x = lo; x <= hi && n < (int)len; x++)
+    {
+        n += snprintf(out + n, len - n, ",%lu", (unsigned long)hist.buckets[x]);
+    }
+    if(n < (int)len) { n += snprintf(out + n, len - n, "]"); }
+    return n < (int)len ? n : len - 1;
+}
@@ -0,0 +1,112 @@
+/**
+ * @file metrics.h
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief Latency histograms and health counters, published on MQTT
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef __metrics_H__
+#define __metrics_H__
+
+#include <Arduino.h>
+#include <sdi.h>
+
+/** Histogram buckets, 0 then powers of 2, the last takes everything above */
+#define METRICS_BUCKETS 24
+/** Sensors tracked, one slot per SDI-12 address, taken as they first report */
+#define METRICS_SENSORS SDI_MAX_ADDR
+/** Longest metrics message */
+#define METRICS_JSON 4096
+/** Default seconds between metrics messages, CMD 14 */
+#define METRICS_PERIOD_S 300
+
+/**
+ * @brief Fixed bucket histogram
+ * Bucket 0 holds 0, bucket b holds 2^(b-1) to 2^b - 1
+ *
+ */
+struct hist_t
+{
+    uint32_t count;
+    uint32_t sum;
+    uint32_t max;
+    uint32_t buckets[METRICS_BUCKETS];
+};
+
+/**
+ * @brief One sensor's figures
+ *
+ */
+struct sensor_metrics_t
+{
+    /** SDI-12 address, 0 for a free slot */
+    char addr;
+    /** [a]M!/[a]C! to data ready, ms */
+    hist_t ready;
+    /** [a]Dn! sent to reply in, micros */
+    hist_t data;
+    /** Commands that got no reply */
+    uint16_t timeouts;
+    /** Replies that could not be parsed */
+    uint16_t parse_fails;
+    /** Replies that failed their CRC */
+    uint16_t crc_fails;
+    /** Commands sent again */
+    uint16_t retries;
+    /** Readings with values past READING_MAX */
+    uint16_t truncated;
+};
+
+/**
+ * @brief Everything since the last report
+ * Updated from several tasks without locks, a report may miss an event
+ * that lands while it is formatted
+ *
+ */
+struct metrics_t
+{
+    /** MQTT publish call, micros */
+    hist_t publish;
+    /** Publishes the broker did not take */
+    uint32_t publish_fails;
+    /** SD log buffer write, sync included, micros */
+    hist_t sd_write;
+    /** Gap between acquisition passes, micros */
+    hist_t loop_gap;
+    /** Sensor figures */
+    sensor_metrics_t sensors[METRICS_SENSORS];
+    /** Readings dropped on a full uplink or SD log queue */
+    uint32_t queue_drops;
+    /** Report start, millis */
+    uint32_t since;
+};
+
+/**
+ * @brief Static storage only, nothing here allocates
+ *
+ */
+void hist_add(hist_t& hist, uint32_t value);
+void metrics_ready(char addr, uint32_t ms);
+void metrics_data(char addr, uint32_t us);
+void metrics_timeout(char addr);
+void metrics_parse_fail(char addr);
+void metrics_crc_fail(char addr);
+void metrics_retry(char addr);
+void metrics_truncated(char addr);
+void metrics_publish(uint32_t us, bool ok);
+void metrics_sd_write(uint32_t us);
+void metrics_loop(uint32_t gap_us);
+void metrics_queue_drop();
+size_t metrics_format(char* out, size_t len);
+void metrics_reset();
+
+/** Figures since the last report */
+extern metrics_t metrics;
+/** Seconds between reports, 0 for none */
+extern uint32_t metrics_period_s;
+
+#endif
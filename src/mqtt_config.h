@@ -14,8 +14,6 @@
 
 #include <Arduino.h>
 
-/** Turn on/off MQTT debug output*/
-#define MQTT_DEBUG 1
 /** Keep wifi/MQTT alive*/
 const uint16_t KEEP_ALIVE = 120;
 /** WiFi credentials */
@@ -0,0 +1,210 @@
+/**
+ * @file packed.cpp
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief Packed binary encoding for readings
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <Arduino.h>
+#include <packed.h>
+
+/** Half a unit in the last digit sent, per number of decimals */
+const float HALF_STEP[] = { 0.5, 0.05, 0.005, 0.0005, 0.00005, 0.000005, 0.0000005, 0.00000005 };
+/** Largest float16 */
+#define HALF_MAX 65504.0f
+
+/** Forward declaration */
+bool pack_byte(packer_t& packer, uint8_t value);
+bool pack_bytes(packer_t& packer, const void* data, size_t len);
+bool pack_varint(packer_t& packer, int32_t value);
+bool fits_half(const reading_t& reading);
+
+/**
+ * @brief Start a message
+ *
+ * @param packer
+ * @param out
+ * @param len size of out
+ * @param epoch base time, the first reading's
+ */
+void pack_start(packer_t& packer, uint8_t* out, size_t len, uint32_t epoch)
+{
+    packer.out = out;
+    packer.len = len;
+    packer.pos = 0;
+    packer.last = epoch;
+    packer.count = 0;
+    pack_byte(packer, PACKED_VERSION);
+    pack_bytes(packer, &epoch, sizeof(epoch));
+    pack_byte(packer, 0);
+}
+
+/**
+ * @brief Add a reading
+ * Nothing is written if it does not fit
+ *
+ * @param packer
+ * @param reading
+ * @return true Added
+ */
+bool pack_add(packer_t& packer, const reading_t& reading)
+{
+    size_t start = packer.pos;
+    if(packer.count == 0xFF || start < PACKED_HEADER) { return false; }
+
+    bool half = fits_half(reading);
+    uint8_t count = reading.count & PACKED_COUNT;
+    bool ok = pack_byte(packer, reading.addr) &&
+        pack_varint(packer, (int32_t)(reading.time - packer.last)) &&
+        pack_byte(packer, count | (reading.truncated > 0 ? PACKED_TRUNC : 0) | (half ? 0 : PACKED_F32));
+    for(uint8_t x = 0; ok && x < count; x += 2)
+    {
+        uint8_t decimals = reading.decimals[x] & 0x0F;
+        if(x + 1 < count) { decimals |= (reading.decimals[x + 1] & 0x0F) << 4; }
+        ok = pack_byte(packer, decimals);
+    }
+    for(uint8_t x = 0; ok && x < count; x++)
+    {
+        if(half)
+        {
+            uint16_t value = float_to_half(reading.values[x]);
+            ok = pack_bytes(packer, &value, sizeof(value));
+        } else {
+            ok = pack_bytes(packer, &reading.values[x], sizeof(float));
+        }
+    }
+
+    if(!ok)
+    {
+        packer.pos = start;
+        return false;
+    }
+    packer.last = reading.time;
+    packer.count++;
+    return true;
+}
+
+/**
+ * @brief Finish a message
+ *
+ * @param packer
+ * @return size_t message length
+ */
+size_t pack_end(packer_t& packer)
+{
+    if(packer.pos < PACKED_HEADER) { return 0; }
+    packer.out[PACKED_HEADER - 1] = packer.count;
+    return packer.pos;
+}
+
+/**
+ * @brief float to IEEE 754 half, rounded to nearest
+ *
+ * @param value
+ * @return uint16_t
+ */
+uint16_t float_to_half(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint16_t sign = (bits >> 16) & 0x8000;
+    int32_t exp = (int32_t)((bits >> 23) & 0xFF) - 127 + 15;
+    uint32_t mant = bits & 0x7FFFFF;
+
+    if(exp >= 31) { return sign | 0x7C00; }
+    if(exp <= 0)
+    {
+        /** Subnormal */
+        if(exp < -10) { return sign; }
+        mant |= 0x800000;
+        uint32_t shift = 14 - exp;
+        uint16_t half = mant >> shift;
+        if((mant >> (shift - 1)) & 1) { half++; }
+        return sign | half;
+    }
+    uint16_t half = sign | (exp << 10) | (mant >> 13);
+    /** Carries into the exponent when the mantissa overflows, which is right */
+    if(mant & 0x1000) { half++; }
+    return half;
+}
+
+/**
+ * @brief IEEE 754 half to float
+ *
+ * @param half
+ * @return float
+ */
+float half_to_float(uint16_t half)
+{
+    uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+    uint32_t exp = (half >> 10) & 0x1F;
+    uint32_t mant = half & 0x3FF;
+    if(exp == 0)
+    {
+        float value = ldexpf(mant, -24);
+        return sign ? -value : value;
+    }
+
+    uint32_t bits = sign | (exp == 31 ? 0xFF << 23 : (exp - 15 + 127) << 23) | (mant << 13);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/**
+ * @brief Every value survives float16 at its decimals
+ *
+ * @param reading
+ * @return true
+ */
+bool fits_half(const reading_t& reading)
+{
+    for(uint8_t x = 0; x < reading.count; x++)
+    {
+        float value = reading.values[x];
+        if(fabsf(value) > HALF_MAX) { return false; }
+        float back = half_to_float(float_to_half(value));
+        if(fabsf(back - value) >= HALF_STEP[reading.decimals[x] & 0x07]) { return false; }
+    }
+    return true;
+}
+
+bool pack_byte(packer_t& packer, uint8_t value)
+{
+    if(packer.pos >= packer.len) { return false; }
+    packer.out[packer.pos++] = value;
+    return true;
+}
+
+/**
+ * @brief Append bytes, ESP32 is little endian like the format
+ *
+ */
+bool pack_bytes(packer_t& packer, const void* data, size_t len)
+{
+    if(packer.pos + len > packer.len) { return false; }
+    memcpy(packer.out + packer.pos, data, len);
+    packer.pos += len;
+    return true;
+}
+
+/**
+ * @brief Append a signed value as zigzag LEB128, 1 byte for -64 to 63
+ *
+ */
+bool pack_varint(packer_t& packer, int32_t value)
+{
+    uint32_t zigzag = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+    do
+    {
+        uint8_t byte = zigzag & 0x7F;
+        zigzag >>= 7;
+        if(zigzag) { byte |= 0x80; }
+        if(!pack_byte(packer, byte)) { return false; }
+    } while(zigzag);
+    return true;
+}
@@ -0,0 +1,70 @@
+/**
+ * @file packed.h
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief Packed binary encoding for readings
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef __packed_H__
+#define __packed_H__
+
+#include <Arduino.h>
+#include <reading.h>
+
+/**
+ * Message layout, little endian, decoder in native/packed_decode.py
+ *
+ *   u8      version, PACKED_VERSION
+ *   u32     base epoch, the first reading's time
+ *   u8      reading count
+ *   reading count times
+ *     u8      SDI-12 address
+ *     varint  time minus the previous reading's (base for the first), zigzag LEB128
+ *     u8      bits 0-4 value count, bit 6 values past READING_MAX were left out,
+ *             bit 7 values are float32 else float16
+ *     u8      per 2 values, decimals of the even value in bits 0-3, odd in 4-7
+ *     values  float16 or float32
+ *
+ * float16 is only used when every value of the reading comes back
+ * the same at its decimals, otherwise the reading is float32
+ */
+#define PACKED_VERSION 1
+/** Version, epoch and count */
+#define PACKED_HEADER 6
+/** Value count bits, the truncated and float32 flags */
+#define PACKED_COUNT 0x1F
+#define PACKED_TRUNC 0x40
+#define PACKED_F32 0x80
+
+#if READING_MAX > PACKED_COUNT
+#error "READING_MAX doesn't fit the packed value count"
+#endif
+
+/**
+ * @brief Message being packed
+ *
+ */
+struct packer_t
+{
+    /** Output buffer and its size */
+    uint8_t* out;
+    size_t len;
+    /** Bytes written */
+    size_t pos;
+    /** Previous reading's time */
+    uint32_t last;
+    /** Readings packed */
+    uint8_t count;
+};
+
+void pack_start(packer_t& packer, uint8_t* out, size_t len, uint32_t epoch);
+bool pack_add(packer_t& packer, const reading_t& reading);
+size_t pack_end(packer_t& packer);
+uint16_t float_to_half(float value);
+float half_to_float(uint16_t half);
+
+#endif
@@ -0,0 +1,116 @@
+/**
+ * @file reading.cpp
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief 
+ * @version 0.1
+ * @date 2026-10-16
+ * 
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+#include <Arduino.h>
+#include <reading.h>
+
+/** Powers of ten for SDI-12 decimal places, 7 digits max */
+const float POW10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000 };
+
+/**
+ * @brief Parse SDI-12 D reply values into a reading
+ * a+1.23-4.5+6 - address then signed values, appended after
+ * any values the reading already holds
+ * 
+ * @param reply 
+ * @param reading 
+ * @return uint8_t values parsed from this reply
+ */
+uint8_t parse_values(const char* reply, reading_t& reading)
+{
+    uint8_t parsed = 0;
+    const char* c = reply;
+    if(*c != 0) { reading.addr = *c++; }
+
+    while(*c != 0)
+    {
+        if(*c != '+' && *c != '-')
+        {
+            c++;
+            continue;
+        }
+
+        bool negative = *c++ == '-';
+        uint32_t mantissa = 0;
+        uint8_t digits = 0;
+        uint8_t decimals = 0;
+        bool point = false;
+        for(; *c != 0 && *c != '+' && *c != '-'; c++)
+        {
+            if(*c == '.')
+            {
+                point = true;
+            } else if(*c >= '0' && *c <= '9' && digits < 9) {
+                mantissa = mantissa*10 + (*c - '0');
+                digits++;
+                if(point) { decimals++; }
+            }
+        }
+
+        /** Sign with no digits, skip it */
+        if(digits == 0) { continue; }
+        if(decimals > 7) { decimals = 7; }
+        parsed++;
+        if(reading.count >= READING_MAX)
+        {
+            if(reading.truncated < UINT8_MAX) { reading.truncated++; }
+            continue;
+        }
+
+        float value = mantissa / POW10[decimals];
+        reading.values[reading.count] = negative ? -value : value;
+        reading.decimals[reading.count] = decimals;
+        reading.count++;
+    }
+
+    return parsed;
+}
+
+/**
+ * @brief Format one reading value as text
+ * 
+ * @param reading 
+ * @param idx value index
+ * @param out 
+ * @param len size of out
+ * @return size_t characters written
+ */
+size_t format_value(const reading_t& reading, uint8_t idx, char* out, size_t len)
+{
+    int n = snprintf(out, len, "%.*f", reading.decimals[idx], reading.values[idx]);
+    if(n < 0) { return 0; }
+    return (size_t)n < len ? n : len - 1;
+}
+
+/**
+ * @brief Format all reading values as text
+ * 
+ * @param reading 
+ * @param sep between values, i.e "," or ", "
+ * @param out 
+ * @param len size of out
+ * @return size_t characters written
+ */
+size_t format_values(const reading_t& reading, const char* sep, char* out, size_t len)
+{
+    size_t pos = 0;
+    out[0] = 0;
+    for(int x = 0; x < reading.count && pos + 1 < len; x++)
+    {
+        if(x > 0)
+        {
+            int n = snprintf(out + pos, len - pos, "%s", sep);
+            pos += (size_t)n < len - pos ? n : len - pos - 1;
+        }
+        pos += format_value(reading, x, out + pos, len - pos);
+    }
+    return pos;
+}
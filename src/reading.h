@@ -0,0 +1,51 @@
+/**
+ * @file reading.h
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief 
+ * @version 0.1
+ * @date 2026-10-16
+ * 
+ * @copyright Copyright (c) 2023
+ * 
+ */
+
+#ifndef __reading_H__
+#define __reading_H__
+
+#include <Arduino.h>
+
+/**
+ * Most values kept from one measurement, [a]C! can announce 99 but the
+ * deep sleep store in RTC memory has no room for readings that size.
+ * Values past this are counted in truncated
+ */
+#define READING_MAX 20
+/** Longest text a reading formats to, sign + 7 digits + point + separator per value */
+#define READING_TEXT 256
+
+/**
+ * @brief One sensor measurement
+ * Filled by the SDI-12 engine, read by MQTT and the logger
+ * 
+ */
+struct reading_t
+{
+    /** Measurement time, epoch seconds, 0 before the clock was set */
+    uint32_t time;
+    /** SDI-12 address */
+    char addr;
+    /** Number of values */
+    uint8_t count;
+    /** Values the sensor sent past READING_MAX, left out */
+    uint8_t truncated;
+    /** Digits after the decimal point, so values print as sent */
+    uint8_t decimals[READING_MAX];
+    /** Values */
+    float values[READING_MAX];
+};
+
+uint8_t parse_values(const char* reply, reading_t& reading);
+size_t format_values(const reading_t& reading, const char* sep, char* out, size_t len);
+size_t format_value(const reading_t& reading, uint8_t idx, char* out, size_t len);
+
+#endif
@@ -0,0 +1,1430 @@
+/**
+ * @file sdi.cpp
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <Arduino.h>
+#include <RAK13010_SDI12.h>
+#include <sdi.h>
+#include <clock.h>
+#include <metrics.h>
+#include <debug.h>
+#include <crc16.h>
+#include <esp_attr.h>
+#include <esp_timer.h>
+#include <algorithm>
+
+/** Pin setup
+ * SDI-12 data bus, TX
+ * SDI-12 data bus, RX
+ * Output enable
+*/
+#define TX_PIN WB_IO6
+#define RX_PIN WB_IO5
+#define OE     WB_IO4
+
+/** Time for a sensor to start replying, ms */
+#define SDI_REPLY_MS 100
+/** Spec max response start is 15 ms, plus the 8.3 ms first character, first scan pass waits just past it */
+#define SDI_ACK_MS 25
+/** Quiet line needed after a timeout before the next break, covers a reply starting up to twice the spec late, ms */
+#define SDI_QUIET_MS 15
+/** Max gap between reply characters, ms */
+#define SDI_GAP_MS 20
+/** Acknowledge retries per address */
+#define SDI_RETRY 3
+/** Longest reply we keep, 75 chars + CRC */
+#define SDI_REPLY_LEN 82
+/** One character on the bus at 1200 baud, 10 bits, micros */
+#define SDI_CHAR_US 8333
+/** Saved inventory layout, bump when sensor_t changes */
+#define INV_VERSION 4
+/** Deep sleep wakes between checks of the kept inventory */
+#define INV_WAKE_CHECK 240
+
+/** RAK SDI-12 Lib */
+RAK_SDI12 sdi12_bus(RX_PIN, TX_PIN, OE);
+/** Use concurrent measurements [a]C! instead of [a]M! */
+bool concurrent = false;
+/** Ask for CRC checked data, [a]MC!/[a]CC!, from sensors that support it */
+bool use_crc = false;
+/** Sub-period continuous sensors are read at, ms, 0 for once a cycle */
+uint32_t fast_ms = 1000;
+/** Number of online sensors */
+uint8_t num_sensors;
+/** Longest time spent clocking a command onto the bus, micros */
+uint32_t bus_tx_max;
+/** Time the bus carried a command or reply, micros */
+uint64_t bus_busy_us;
+/** Completed measurement cycles */
+uint32_t sdi_cycles;
+/** Readings handed to sdi_reading() */
+uint32_t sdi_readings;
+/** Last measurement cycle time, ms */
+uint32_t cycle_ms;
+/** Current measurement cycle start, millis */
+uint32_t cycle_start;
+/** Only one sensor on the bus, trust the ?! wildcard */
+bool single_sensor = false;
+/** Bit per address of sensors found online, see sdi_index() */
+uint64_t online_mask;
+/** Sensor table, indexed by sdi_index(), empty slots have addr 0 */
+sensor_t sensors[SDI_MAX_ADDR];
+/** Inventory changed since it was saved */
+bool inv_dirty = false;
+/** Warm boot, check the saved inventory after the first cycle */
+bool inv_validate = false;
+/** Online sensors kept in RTC memory through deep sleep, packed from the start */
+RTC_DATA_ATTR sensor_t rtc_sensors[SDI_MAX_ADDR];
+RTC_DATA_ATTR uint8_t rtc_count = 0;
+/** Wakes since the kept inventory was last checked on the bus */
+RTC_DATA_ATTR uint32_t rtc_wakes = 0;
+
+/** What the bus is being used for */
+enum sdi_job_t : uint8_t { JOB_IDLE, JOB_SCAN, JOB_ADDR, JOB_MEASURE };
+/** Scan phases */
+enum scan_phase_t : uint8_t { SCAN_WILD, SCAN_FAST, SCAN_RETRY, SCAN_INFO };
+/** Sensor transaction states */
+enum sdi_state_t : uint8_t { SDI_START, SDI_WAIT, SDI_DATA, SDI_DONE };
+/** Bus reply status */
+enum bus_status_t : uint8_t { BUS_BUSY, BUS_REPLY, BUS_TIMEOUT };
+
+/** Current bus job */
+uint8_t sdi_job = JOB_IDLE;
+/** Command in flight */
+char bus_cmd[8];
+/** Reply being received */
+char bus_reply[SDI_REPLY_LEN];
+/** Reply length */
+uint8_t bus_len;
+/** When to give up on the reply, millis */
+uint32_t bus_deadline;
+/** When the command in flight was sent, micros */
+uint32_t bus_sent;
+/** Waiting on a reply */
+bool bus_waiting = false;
+/** Timed out, waiting for the line to go quiet, until millis */
+bool bus_settling = false;
+uint32_t bus_quiet;
+
+/** Addresses waiting to be scanned */
+uint64_t scan_pending;
+/** Full scan requested, start with the ?! wildcard */
+bool scan_pending_full = false;
+/** Address change requested, old and new */
+char addr_pending[2];
+/** Address change in flight, rescanned once done */
+char addr_chng[2];
+/** Current scan phase */
+uint8_t scan_phase;
+/** Addresses this scan covers */
+uint64_t scan_probe;
+/** Addresses left for the fast pass */
+uint64_t scan_fast;
+/** Addresses that need a slow retry */
+uint64_t scan_suspect;
+/** Addresses that answered */
+uint64_t scan_found;
+/** Scan position, 0 to SDI_MAX_ADDR */
+uint8_t scan_idx;
+/** Scan retry for current address */
+uint8_t scan_try;
+
+/** Per sensor transaction state, indexed as sensors */
+uint8_t meas_state[SDI_MAX_ADDR];
+/** When each sensor's measurement was started, millis */
+uint32_t meas_sent[SDI_MAX_ADDR];
+/** When each sensor has data ready, millis */
+uint32_t meas_ready[SDI_MAX_ADDR];
+/** Next D command to send */
+uint8_t meas_dnext;
+/** Tries of the current D command */
+uint8_t meas_try;
+/** Values collected so far, may be more than the reading holds */
+uint8_t meas_got;
+/** Job is a full cycle, not just continuous reads */
+bool meas_full;
+/** Continuous reads due, millis */
+uint32_t fast_next;
+/** Sensor that owns the bus, -1 for none */
+int8_t meas_cur = -1;
+/** Reading being collected */
+reading_t meas_reading;
+
+/** Scheduled sensor and when it's next due, sched_now() seconds */
+struct sched_t
+{
+    uint32_t due;
+    uint8_t idx;
+};
+/** Sensors with their own period, min-heap on due then priority */
+sched_t sched_heap[SDI_MAX_ADDR];
+uint8_t sched_count;
+/** Schedules changed, rebuild the heap once the bus is idle */
+bool sched_dirty = false;
+/** Next due per sensor, indexed as sensors, 0 to pick the next slot, kept through deep sleep */
+RTC_DATA_ATTR uint32_t sched_due[SDI_MAX_ADDR];
+
+/** Forward declaration */
+void bus_send(const char* cmd, uint16_t timeout_ms = SDI_REPLY_MS);
+void bus_listen(uint32_t until);
+uint8_t bus_poll();
+bool bus_settle();
+void step_scan();
+void scan_reply(uint8_t status);
+void scan_done();
+int8_t next_addr(uint64_t mask, uint8_t from);
+void step_addr();
+void step_measure();
+void measure_reply(uint8_t status);
+void measure_data(uint8_t x);
+void data_send(const sensor_t& sensor);
+bool fast_due();
+void fast_start();
+uint32_t sched_now();
+uint32_t sched_slot(const sensor_t& sensor, uint32_t from);
+bool sched_keep(const sensor_t& sensor, uint32_t due);
+bool sched_later(const sched_t& a, const sched_t& b);
+void sched_build();
+bool sched_ready();
+void sched_start();
+bool crc_mode(const sensor_t& sensor);
+bool crc_strip();
+void set_lookup(sensor_t& sensor);
+const char* ds_key(const sensor_t& sensor);
+void parse_info(const char* reply, sensor_t& sensor);
+bool inventory_load();
+void inventory_save();
+bool inventory_wake();
+char sdi_addr(uint8_t idx);
+int8_t sdi_index(char addr);
+
+/**
+ * @brief Start SDI-12 bus and queue a scan
+ *
+ */
+void SDI::sdi_setup()
+{
+    SDI_LOG(LVL_INFO, "SDI-12", "Starting bus");
+    sdi12_bus.begin();
+    delay(500);
+
+    sdi12_bus.forceListen();
+
+    /** Measure saved sensors right away, scan once that's done */
+    if(inventory_wake())
+    {
+        SDI_LOG(LVL_INFO, "SDI-12", "Woke, sensors: %u", num_sensors);
+        if(++rtc_wakes >= INV_WAKE_CHECK)
+        {
+            rtc_wakes = 0;
+            inv_validate = true;
+        }
+    } else if(inventory_load())
+    {
+        SDI_LOG(LVL_INFO, "SDI-12", "Warm boot, sensors: %u", num_sensors);
+        inv_validate = true;
+    } else {
+        cache_online();
+    }
+}
+
+/**
+ * @brief Keep the sensor table in RTC memory through deep sleep
+ * Call with the bus idle
+ *
+ */
+void SDI::sdi_sleep()
+{
+    if(inv_dirty) { inventory_save(); }
+    rtc_count = 0;
+    bool continuous = false;
+    for(int x = 0; x < SDI_MAX_ADDR; x++)
+    {
+        if(sensors[x].addr != 0) { rtc_sensors[rtc_count++] = sensors[x]; }
+        if(sensors[x].addr != 0 && sensors[x].r_cmds > 0) { continuous = true; }
+    }
+    /** Waking every fast_ms would cost more than it reads, they wait for the next wake */
+    if(continuous && fast_ms > 0)
+    {
+        SDI_LOG(LVL_WARN, "SDI-12", "Deep sleep, continuous reads run once a wake, not every %lums", (unsigned long)fast_ms);
+    }
+    sdi12_bus.end();
+}
+
+/**
+ * @brief Step the current bus job
+ * Pending scans and address changes start once the bus is idle
+ *
+ */
+void SDI::sdi_loop()
+{
+    if(bus_settle()) { return; }
+
+    if(sdi_job == JOB_IDLE)
+    {
+        if(sched_dirty) { sched_build(); }
+        if(addr_pending[0] != 0)
+        {
+            char cmd[5] = { addr_pending[0], 'A', addr_pending[1], '!', 0 };
+            addr_chng[0] = addr_pending[0];
+            addr_chng[1] = addr_pending[1];
+            addr_pending[0] = 0;
+            sdi_job = JOB_ADDR;
+            bus_send(cmd);
+        } else if(scan_pending != 0) {
+            scan_probe = scan_pending;
+            scan_fast = scan_pending;
+            scan_phase = scan_pending_full ? SCAN_WILD : SCAN_FAST;
+            scan_pending = 0;
+            scan_pending_full = false;
+            scan_suspect = 0;
+            scan_found = 0;
+            scan_idx = 0;
+            scan_try = 0;
+            sdi_job = JOB_SCAN;
+        } else if(fast_due() || sched_ready()) {
+            /** Continuous and scheduled reads between cycles */
+            memset(meas_state, SDI_DONE, sizeof(meas_state));
+            meas_cur = -1;
+            meas_full = false;
+            fast_start();
+            sched_start();
+            sdi_job = JOB_MEASURE;
+        }
+    }
+
+    switch(sdi_job)
+    {
+        case JOB_SCAN:
+            step_scan();
+        break;
+        case JOB_ADDR:
+            step_addr();
+        break;
+        case JOB_MEASURE:
+            step_measure();
+        break;
+    }
+}
+
+/**
+ * @brief Start a measurement cycle of all cached sensors
+ * Measure: [a]M! or [a]C! then Data: [a]D[0-9]!
+ * Sensors with their own period are left to the schedule
+ *
+ * @param all Every sensor on the cycle, false for a cycle of only the scheduled sensors due
+ */
+void SDI::sdi_measure(bool all)
+{
+    if(sdi_job != JOB_IDLE) { return; }
+
+    for(int x = 0; x < SDI_MAX_ADDR; x++)
+    {
+        meas_state[x] = all && sensors[x].addr && sensors[x].period_s == 0 ? SDI_START : SDI_DONE;
+    }
+    meas_cur = -1;
+    meas_full = true;
+    cycle_start = millis();
+    sdi_job = JOB_MEASURE;
+}
+
+/**
+ * @brief Is the SDI-12 bus free for a new cycle
+ *
+ * @return true bus idle
+ * @return false job running or pending
+ */
+bool SDI::sdi_idle()
+{
+    return sdi_job == JOB_IDLE && scan_pending == 0 && addr_pending[0] == 0;
+}
+
+/**
+ * @brief Time until the next scheduled sensor is due, deep sleep wakes for it
+ * Call with the bus idle
+ *
+ * @return uint64_t micros, 0 once one is due, UINT64_MAX with no schedule
+ */
+uint64_t SDI::sdi_sched_us()
+{
+    if(sched_dirty) { sched_build(); }
+    if(sched_count == 0) { return UINT64_MAX; }
+
+    uint64_t now_ms = get_epoch_ms();
+    if(now_ms == 0) { now_ms = esp_timer_get_time() / 1000; }
+    uint64_t due_ms = (uint64_t)sched_heap[0].due * 1000;
+    return due_ms > now_ms ? (due_ms - now_ms) * 1000 : 0;
+}
+
+/**
+ * @brief Send a command and start waiting on its reply
+ *
+ * @param cmd
+ * @param timeout_ms Time for the reply to start
+ */
+void bus_send(const char* cmd, uint16_t timeout_ms)
+{
+    sdi12_bus.clearBuffer();
+    strncpy(bus_cmd, cmd, sizeof(bus_cmd) - 1);
+    bus_len = 0;
+    bus_reply[0] = 0;
+
+    /** sendCommand clocks the break and characters out, time it */
+    uint32_t start = micros();
+    bus_sent = start;
+    sdi12_bus.sendCommand(bus_cmd);
+    uint32_t took = micros() - start;
+    if(took > bus_tx_max) { bus_tx_max = took; }
+    bus_busy_us += took;
+
+    bus_deadline = millis() + timeout_ms;
+    bus_waiting = true;
+    SDI_LOG(LVL_DEBUG, "SDI-12", "Sent: %s", bus_cmd);
+}
+
+/**
+ * @brief Wait on a line from a sensor without sending a command
+ * i.e a service request after [a]M!
+ *
+ * @param until Give up at, millis
+ */
+void bus_listen(uint32_t until)
+{
+    bus_len = 0;
+    bus_reply[0] = 0;
+    bus_deadline = until;
+    bus_waiting = true;
+}
+
+/**
+ * @brief Collect reply characters without blocking
+ *
+ * @return uint8_t BUS_BUSY, BUS_REPLY or BUS_TIMEOUT
+ */
+uint8_t bus_poll()
+{
+    while(sdi12_bus.available() > 0)
+    {
+        char c = sdi12_bus.read();
+        bus_busy_us += SDI_CHAR_US;
+        /** Keep waiting while characters still arrive */
+        uint32_t gap = millis() + SDI_GAP_MS;
+        if((int32_t)(gap - bus_deadline) > 0) { bus_deadline = gap; }
+        if(c == '\n')
+        {
+            bus_waiting = false;
+            SDI_LOG(LVL_DEBUG, "SDI-12", "Reply: %s", bus_reply);
+            return BUS_REPLY;
+        }
+        /** Drop CR and line noise */
+        if(c >= ' ' && bus_len < SDI_REPLY_LEN - 1)
+        {
+            bus_reply[bus_len++] = c;
+            bus_reply[bus_len] = 0;
+        }
+    }
+
+    if((int32_t)(millis() - bus_deadline) >= 0)
+    {
+        bus_waiting = false;
+        if(bus_len > 0)
+        {
+            SDI_LOG(LVL_DEBUG, "SDI-12", "Reply: %s", bus_reply);
+            return BUS_REPLY;
+        }
+        /** A late reply may still be coming, hold the next break until it's done */
+        bus_settling = true;
+        bus_quiet = millis() + SDI_QUIET_MS;
+        return BUS_TIMEOUT;
+    }
+
+    return BUS_BUSY;
+}
+
+/**
+ * @brief Wait out a reply that missed its window
+ * Characters seen are dropped and push the quiet time out,
+ * so the next command never breaks over a sensor or reads its tail
+ *
+ * @return true Bus still settling, send nothing
+ */
+bool bus_settle()
+{
+    if(!bus_settling) { return false; }
+    while(sdi12_bus.available() > 0)
+    {
+        sdi12_bus.read();
+        bus_busy_us += SDI_CHAR_US;
+        bus_quiet = millis() + SDI_GAP_MS;
+    }
+    if((int32_t)(millis() - bus_quiet) < 0) { return true; }
+    bus_settling = false;
+    return false;
+}
+
+/**
+ * @brief Find online SDI-12 sensor addresses
+ * Wildcard: ?! - Any single sensor replies with its address
+ * Acknowledge: [a]! - Sensor at that address is online
+ * Info: [a]I! - Returns information about the sensor
+ *
+ * First pass gives every address one try at the spec timeout,
+ * only garbled replies and known sensors that went quiet
+ * get the slow retries
+ *
+ */
+void step_scan()
+{
+    if(bus_waiting)
+    {
+        uint8_t status = bus_poll();
+        if(status != BUS_BUSY) { scan_reply(status); }
+        return;
+    }
+
+    char cmd[4] = { 0, '!', 0, 0 };
+    int8_t idx;
+    switch(scan_phase)
+    {
+        case SCAN_WILD:
+            bus_send("?!", SDI_ACK_MS);
+        return;
+        case SCAN_FAST:
+            /** Skip the address the wildcard already found */
+            idx = next_addr(scan_fast & ~scan_found, scan_idx);
+            if(idx >= 0)
+            {
+                scan_idx = idx;
+                cmd[0] = sdi_addr(idx);
+                bus_send(cmd, SDI_ACK_MS);
+                return;
+            }
+            scan_phase = SCAN_RETRY;
+            scan_idx = 0;
+            [[fallthrough]];
+        case SCAN_RETRY:
+            idx = next_addr(scan_suspect, scan_idx);
+            if(idx >= 0)
+            {
+                scan_idx = idx;
+                cmd[0] = sdi_addr(idx);
+                bus_send(cmd);
+                return;
+            }
+            scan_phase = SCAN_INFO;
+            scan_idx = 0;
+            [[fallthrough]];
+        case SCAN_INFO:
+            idx = next_addr(scan_found, scan_idx);
+            if(idx >= 0)
+            {
+                scan_idx = idx;
+                cmd[0] = sdi_addr(idx);
+                cmd[1] = 'I';
+                cmd[2] = '!';
+                bus_send(cmd);
+                return;
+            }
+            scan_done();
+        return;
+    }
+}
+
+/**
+ * @brief Handle the reply to a scan command
+ *
+ * @param status BUS_REPLY or BUS_TIMEOUT
+ */
+void scan_reply(uint8_t status)
+{
+    uint64_t bit = 1ULL << scan_idx;
+    char addr = sdi_addr(scan_idx);
+    /** Exactly [a]<CR><LF> */
+    bool clean = status == BUS_REPLY && bus_len == 1;
+
+    switch(scan_phase)
+    {
+        case SCAN_WILD:
+            if(clean && sdi_index(bus_reply[0]) >= 0)
+            {
+                SDI_LOG(LVL_INFO, "SDI-12", "Wildcard found: %c", bus_reply[0]);
+                scan_found |= 1ULL << sdi_index(bus_reply[0]);
+                /** One sensor answered cleanly and only one is wired */
+                if(single_sensor) { scan_fast = 0; }
+            } else if(status == BUS_TIMEOUT && ++scan_try < SDI_RETRY) {
+                return;
+            } else if(status == BUS_TIMEOUT) {
+                /** Empty bus, only double check sensors we knew of */
+                SDI_LOG(LVL_WARN, "SDI-12", "No reply to wildcard");
+                scan_suspect = scan_probe & online_mask;
+                scan_fast = 0;
+            }
+            /** Garbled means several sensors replied, scan them all */
+            scan_phase = SCAN_FAST;
+            scan_idx = 0;
+            scan_try = 0;
+        break;
+        case SCAN_FAST:
+            if(clean && bus_reply[0] == addr)
+            {
+                SDI_LOG(LVL_INFO, "SDI-12", "Sensor found on: %c", addr);
+                scan_found |= bit;
+            } else if(status == BUS_REPLY || (online_mask & bit)) {
+                /** Garbled, or a known sensor went quiet */
+                scan_suspect |= bit;
+            }
+            scan_idx++;
+        break;
+        case SCAN_RETRY:
+            if(status == BUS_REPLY && bus_reply[0] == addr)
+            {
+                SDI_LOG(LVL_INFO, "SDI-12", "Sensor found on: %c", addr);
+                scan_found |= bit;
+            } else if(++scan_try < SDI_RETRY) {
+                if(online_mask & bit) { metrics_retry(addr); }
+                return;
+            } else {
+                SDI_LOG(LVL_WARN, "SDI-12", "No sensor found on: %c", addr);
+            }
+            scan_idx++;
+            scan_try = 0;
+        break;
+        case SCAN_INFO:
+            parse_info(bus_reply, sensors[scan_idx]);
+            /** Keep the slot even if [a]I! went unanswered */
+            sensors[scan_idx].addr = addr;
+            set_lookup(sensors[scan_idx]);
+            scan_idx++;
+        break;
+    }
+}
+
+/**
+ * @brief Merge scan results into the address cache
+ * Addresses outside this scan are left as they were
+ *
+ */
+void scan_done()
+{
+    online_mask = (online_mask & ~scan_probe) | scan_found;
+    num_sensors = 0;
+    for(int x = 0; x < SDI_MAX_ADDR; x++)
+    {
+        if(!(online_mask & (1ULL << x)))
+        {
+            sensors[x].addr = 0;
+            continue;
+        }
+        SDI_LOG(LVL_DEBUG, "SDI-12", "Address cached: %c", sensors[x].addr);
+        num_sensors++;
+    }
+    sdi_job = JOB_IDLE;
+    SDI_LOG(LVL_INFO, "SDI-12", "Scan done, sensors: %u", num_sensors);
+    inventory_save();
+}
+
+/**
+ * @brief Next address set in mask
+ *
+ * @param mask Bit per address
+ * @param from First index to check
+ * @return int8_t index, -1 for none left
+ */
+int8_t next_addr(uint64_t mask, uint8_t from)
+{
+    for(int x = from; x < SDI_MAX_ADDR; x++)
+    {
+        if(mask & (1ULL << x)) { return x; }
+    }
+    return -1;
+}
+
+/**
+ * @brief Wait on change address reply then rescan
+ * only the old and new address
+ *
+ */
+void step_addr()
+{
+    if(bus_poll() == BUS_BUSY) { return; }
+
+    sdi_job = JOB_IDLE;
+    int8_t idx_old = sdi_index(addr_chng[0]);
+    int8_t idx_new = sdi_index(addr_chng[1]);
+    uint64_t mask = 0;
+    if(idx_old >= 0) { mask |= 1ULL << idx_old; }
+    if(idx_new >= 0) { mask |= 1ULL << idx_new; }
+    cache_rescan(mask);
+}
+
+/**
+ * @brief Step every sensor's measurement transaction
+ * In [a]M! mode a sensor holds the bus until its data is collected
+ * In [a]C! mode all sensors are started, then collected as they become ready
+ *
+ */
+void step_measure()
+{
+    if(bus_waiting)
+    {
+        uint8_t status = bus_poll();
+        if(status != BUS_BUSY) { measure_reply(status); }
+        return;
+    }
+
+    if(meas_cur >= 0)
+    {
+        if(meas_state[meas_cur] == SDI_WAIT) { measure_data(meas_cur); }
+        data_send(sensors[meas_cur]);
+        return;
+    }
+
+    /** Fit continuous and scheduled reads in while the bus is free */
+    fast_start();
+    sched_start();
+
+    /** Start the highest priority sensor not yet measuring */
+    int x = -1;
+    for(int y = 0; y < SDI_MAX_ADDR; y++)
+    {
+        if(meas_state[y] == SDI_START && (x < 0 || sensors[y].priority > sensors[x].priority)) { x = y; }
+    }
+    if(x >= 0)
+    {
+        meas_cur = x;
+        meas_sent[x] = millis();
+        /** Continuous sensors always have data, no measurement to wait on */
+        if(sensors[x].r_cmds > 0)
+        {
+            measure_data(x);
+            return;
+        }
+        char cmd[5] = { sensors[x].addr, concurrent ? 'C' : 'M', '!', 0, 0 };
+        if(crc_mode(sensors[x]))
+        {
+            cmd[2] = 'C';
+            cmd[3] = '!';
+        }
+        bus_send(cmd);
+        return;
+    }
+
+    /** Collect whichever waiting sensor is ready first */
+    int next = -1;
+    for(int x = 0; x < SDI_MAX_ADDR; x++)
+    {
+        if(meas_state[x] == SDI_WAIT && (next < 0 || (int32_t)(meas_ready[x] - meas_ready[next]) < 0))
+        {
+            next = x;
+        }
+    }
+
+    if(next < 0)
+    {
+        sdi_job = JOB_IDLE;
+        /** Continuous reads alone aren't a cycle */
+        if(!meas_full) { return; }
+        sdi_cycles++;
+        cycle_ms = millis() - cycle_start;
+        SDI_LOG(LVL_INFO, "SDI-12", "Cycle done in %lums", (unsigned long)cycle_ms);
+        sdi_cycle_done();
+        if(inv_dirty) { inventory_save(); }
+        if(inv_validate)
+        {
+            inv_validate = false;
+            cache_online();
+        }
+        return;
+    }
+
+    if((int32_t)(millis() - meas_ready[next]) >= 0)
+    {
+        SDI_LOG(LVL_DEBUG, "SDI-12", "%c ready, values: %u", sensors[next].addr, sensors[next].values);
+        meas_cur = next;
+    }
+}
+
+/**
+ * @brief Sensor has data ready, start collecting from D0
+ *
+ * @param x
+ */
+void measure_data(uint8_t x)
+{
+    if(sensors[x].r_cmds == 0) { metrics_ready(sensors[x].addr, millis() - meas_sent[x]); }
+    meas_state[x] = SDI_DATA;
+    meas_dnext = 0;
+    meas_try = 0;
+    meas_got = 0;
+    meas_reading.count = 0;
+    meas_reading.truncated = 0;
+}
+
+/**
+ * @brief Send the next data command, [a]D[0-9]! or [a]R[0-9]!
+ * Continuous reads ask for their CRC with [a]RC[0-9]!
+ *
+ * @param sensor
+ */
+void data_send(const sensor_t& sensor)
+{
+    char cmd[6] = { sensor.addr, 'D', 0, 0, 0, 0 };
+    uint8_t len = 2;
+    if(sensor.r_cmds > 0)
+    {
+        cmd[1] = 'R';
+        if(crc_mode(sensor)) { cmd[len++] = 'C'; }
+    }
+    cmd[len++] = '0' + meas_dnext;
+    cmd[len] = '!';
+    bus_send(cmd);
+}
+
+/**
+ * @brief Continuous reads are due and there is a sensor to read
+ *
+ * @return true
+ */
+bool fast_due()
+{
+    if(fast_ms == 0 || (int32_t)(millis() - fast_next) < 0) { return false; }
+    for(int x = 0; x < SDI_MAX_ADDR; x++)
+    {
+        if(sensors[x].addr != 0 && sensors[x].r_cmds > 0) { return true; }
+    }
+    return false;
+}
+
+/**
+ * @brief Queue continuous sensors not busy this job once they're due
+ *
+ */
+void fast_start()
+{
+    if(!fast_due()) { return; }
+    fast_next = millis() + fast_ms;
+    for(int x = 0; x < SDI_MAX_ADDR; x++)
+    {
+        if(sensors[x].addr != 0 && sensors[x].r_cmds > 0 && meas_state[x] == SDI_DONE)
+        {
+            meas_state[x] = SDI_START;
+        }
+    }
+}
+
+/**
+ * @brief Schedule clock, epoch seconds, seconds since boot until the clock is set
+ *
+ * @return uint32_t
+ */
+uint32_t sched_now()
+{
+    uint32_t epoch = get_epoch();
+    return epoch != 0 ? epoch : esp_timer_get_time() / 1000000;
+}
+
+/**
+ * @brief First slot of a sensor's schedule at or after from
+ * Slots fall phase_s past each multiple of period_s, so a
+ * 900 s period with a 60 s phase reads at :01, :16, :31 and :46
+ *
+ * @param sensor
+ * @param from sched_now() seconds
+ * @return uint32_t
+ */
+uint32_t sched_slot(const sensor_t& sensor, uint32_t from)
+{
+    uint32_t slot = from - from % sensor.period_s + sensor.phase_s % sensor.period_s;
+    return slot < from ? slot + sensor.period_s : slot;
+}
+
+/**
+ * @brief A kept due time is still the sensor's next slot
+ * Otherwise the schedule changed, or the slot went by while the sensor
+ * was gone or being scanned, and it waits for the next one on its phase
+ *
+ * @param sensor
+ * @param due sched_now() seconds, 0 for none
+ * @return true keep it
+ */
+bool sched_keep(const sensor_t& sensor, uint32_t due)
+{
+    return sensor.period_s != 0 && due != 0 && due == sched_slot(sensor, sched_now());
+}
+
+/**
+ * @brief Heap order, a goes after b
+ * Earliest due first, higher priority first when due together
+ *
+ */
+bool sched_later(const sched_t& a, const sched_t& b)
+{
+    if(a.due != b.due) { return (int32_t)(a.due - b.due) > 0; }
+    return sensors[a.idx].priority < sensors[b.idx].priority;
+}
+
+/**
+ * @brief Rebuild the schedule heap from the sensor table
+ * Sensors keep their due time unless set_lookup() cleared it
+ *
+ */
+void sched_build()
+{
+    sched_dirty = false;
+    sched_count = 0;
+    uint32_t now = sched_now();
+    for(int x = 0; x < SDI_MAX_ADDR; x++)
+    {
+        if(sensors[x].addr == 0 || sensors[x].period_s == 0) { continue; }
+        if(sched_due[x] == 0) { sched_due[x] = sched_slot(sensors[x], now); }
+        sched_heap[sched_count++] = { sched_due[x], (uint8_t)x };
+    }
+    std::make_heap(sched_heap, sched_heap + sched_count, sched_later);
+}
+
+/**
+ * @brief A scheduled sensor is due
+ *
+ * @return true
+ */
+bool sched_ready()
+{
+    return sched_count > 0 && (int32_t)(sched_now() - sched_heap[0].due) >= 0;
+}
+
+/**
+ * @brief Queue every scheduled sensor that is due and book its next slot
+ * A sensor already busy this job counts as read, missed slots are skipped
+ *
+ */
+void sched_start()
+{
+    uint32_t now = sched_now();
+    while(sched_ready())
+    {
+        std::pop_heap(sched_heap, sched_heap + sched_count, sched_later);
+        uint8_t x = sched_heap[--sched_count].idx;
+        /** Left the bus or went back to the cycle since it was queued */
+        if(sensors[x].addr == 0 || sensors[x].period_s == 0) { continue; }
+
+        if(meas_state[x] == SDI_DONE) { meas_state[x] = SDI_START; }
+        sched_due[x] = sched_slot(sensors[x], now + 1);
+        sched_heap[sched_count++] = { sched_due[x], x };
+        std::push_heap(sched_heap, sched_heap + sched_count, sched_later);
+    }
+}
+
+/**
+ * @brief Pack a CMD 18 schedule for flash
+ * period_s in bits 0-31, phase_s in 32-55, priority in 56-63
+ *
+ * @param period_s
+ * @param phase_s
+ * @param priority
+ * @return uint64_t
+ */
+uint64_t sched_pack(uint32_t period_s, uint32_t phase_s, uint8_t priority)
+{
+    return period_s | (uint64_t)(phase_s & 0xFFFFFF) << 32 | (uint64_t)priority << 56;
+}
+
+/**
+ * @brief Handle the reply to a measure or data command
+ * or the service request [a] that ends an [a]M! wait
+ *
+ * @param status BUS_REPLY or BUS_TIMEOUT
+ */
+void measure_reply(uint8_t status)
+{
+    uint8_t x = meas_cur;
+    sensor_t& sensor = sensors[x];
+    if(meas_state[x] == SDI_WAIT)
+    {
+        if(status == BUS_REPLY && bus_reply[0] != sensor.addr)
+        {
+            /** Not our service request, keep listening */
+            bus_listen(meas_ready[x]);
+            return;
+        }
+
+        if(status == BUS_REPLY)
+        {
+            SDI_LOG(LVL_DEBUG, "SDI-12", "Service request from %c", sensor.addr);
+        } else {
+            SDI_LOG(LVL_INFO, "SDI-12", "No service request from %c", sensor.addr);
+        }
+        measure_data(x);
+        return;
+    }
+
+    if(meas_state[x] == SDI_START)
+    {
+        /** atttn carries no CRC, a garbled value count would cut the reading short */
+        bool digits = bus_len >= 4;
+        for(uint8_t y = 1; digits && y < bus_len; y++)
+        {
+            digits = isdigit((unsigned char)bus_reply[y]);
+        }
+        /** No reply, skip sensor this cycle */
+        if(status != BUS_REPLY || !digits)
+        {
+            if(status != BUS_REPLY)
+            {
+                metrics_timeout(sensor.addr);
+            } else {
+                metrics_parse_fail(sensor.addr);
+            }
+            meas_state[x] = SDI_DONE;
+            meas_cur = -1;
+            return;
+        }
+
+        char ttt[4] = { bus_reply[1], bus_reply[2], bus_reply[3], 0 };
+        uint16_t wait = atoi(ttt);
+        uint8_t values = atoi(bus_reply + 4);
+        if(sensor.values != values)
+        {
+            sensor.values = values;
+            inv_dirty = true;
+        }
+        meas_state[x] = SDI_WAIT;
+        if(concurrent)
+        {
+            meas_ready[x] = millis() + wait*1000;
+            /** Let the next sensor start */
+            meas_cur = -1;
+        } else if(wait == 0) {
+            /** Data ready now, no service request will come */
+            measure_data(x);
+        } else {
+            /**
+             * Sensor sends a service request once done, which is
+             * usually well before ttt. Only fall back to ttt plus
+             * 1 second padding if it never arrives
+             */
+            meas_ready[x] = millis() + (wait+1)*1000;
+            SDI_LOG(LVL_DEBUG, "SDI-12", "Waiting on service request, max: %u", wait + 1);
+            bus_listen(meas_ready[x]);
+        }
+        return;
+    }
+
+    if(status != BUS_REPLY)
+    {
+        metrics_timeout(sensor.addr);
+    } else {
+        metrics_data(sensor.addr, micros() - bus_sent);
+    }
+
+    /**
+     * The sensor holds its data until the next measurement, so a
+     * bad or missing reply only costs this D command again.
+     * A timeout is only missing data while values are still owed
+     */
+    bool bad = status != BUS_REPLY && (meas_got == 0 || meas_got < sensor.values);
+    if(status == BUS_REPLY && crc_mode(sensor) && !crc_strip())
+    {
+        metrics_crc_fail(sensor.addr);
+        bad = true;
+    }
+    uint8_t count = 0;
+    if(!bad)
+    {
+        count = parse_values(bus_reply, meas_reading);
+        /** Anything past the address should have been values */
+        if(status == BUS_REPLY && (bus_reply[0] != sensor.addr || (count == 0 && bus_len > 1)))
+        {
+            metrics_parse_fail(sensor.addr);
+        }
+        /** Without a CMD 3/16 override an empty reply while values are owed is as good as none */
+        bad = count == 0 && sensor.r_cmds == 0 && sensor.d_cmds == 0 && meas_got < sensor.values;
+    }
+    if(bad)
+    {
+        if(++meas_try < SDI_RETRY)
+        {
+            metrics_retry(sensor.addr);
+            SDI_LOG(LVL_WARN, "SDI-12", "Bad D%u from %c, asking again", meas_dnext, sensor.addr);
+            return;
+        }
+        /** Part of a reading is worse than none, skip sensor this cycle */
+        SDI_LOG(LVL_WARN, "SDI-12", "Dropped reading from %c, D%u failed", sensor.addr, meas_dnext);
+        sdi12_bus.clearBuffer();
+        meas_state[x] = SDI_DONE;
+        meas_cur = -1;
+        return;
+    }
+    meas_try = 0;
+    meas_got += count;
+
+    /**
+     * CMD 16 continuous reads and CMD 3 data set overrides, otherwise keep
+     * going until all nn values are in
+     */
+    bool more;
+    if(sensor.r_cmds > 0)
+    {
+        more = meas_dnext + 1 < sensor.r_cmds;
+    } else if(sensor.d_cmds > 0)
+    {
+        more = meas_dnext + 1 < sensor.d_cmds;
+    } else {
+        more = meas_got < sensor.values && count > 0 && meas_dnext < 9;
+    }
+    if(more)
+    {
+        meas_dnext++;
+        return;
+    }
+
+    sdi12_bus.clearBuffer();
+    meas_reading.addr = sensor.addr;
+    meas_reading.time = get_epoch();
+    if(meas_reading.truncated > 0)
+    {
+        metrics_truncated(sensor.addr);
+        SDI_LOG(LVL_WARN, "SDI-12", "Reading from %c truncated, %u values past %u left out", sensor.addr,
+            meas_reading.truncated, READING_MAX);
+    }
+    sdi_readings++;
+    sdi_reading(meas_reading);
+    meas_state[x] = SDI_DONE;
+    meas_cur = -1;
+}
+
+/**
+ * @brief CRC checked data for this sensor
+ * [a]MC! came in with SDI-12 1.3, older sensors get plain [a]M!
+ *
+ * @param sensor
+ * @return true
+ */
+bool crc_mode(const sensor_t& sensor)
+{
+    return use_crc && atoi(sensor.sdi_version) >= 13;
+}
+
+/**
+ * @brief Check and drop the CRC ending a D reply
+ * Three characters, 0x40 | 6 bits of the CRC each, high bits first,
+ * over everything from the address to the last value
+ *
+ * @return true CRC matches
+ */
+bool crc_strip()
+{
+    if(bus_len < 4) { return false; }
+    uint8_t len = bus_len - 3;
+    uint16_t crc = crc16((const uint8_t*)bus_reply, len);
+    const char* tail = bus_reply + len;
+    if(tail[0] != (char)(0x40 | (crc >> 12)) ||
+        tail[1] != (char)(0x40 | ((crc >> 6) & 0x3F)) ||
+        tail[2] != (char)(0x40 | (crc & 0x3F)))
+    {
+        return false;
+    }
+    bus_len = len;
+    bus_reply[len] = 0;
+    return true;
+}
+
+/**
+ * @brief Set sensor D command count from its saved data set
+ * CMD 3 stores the last data set, zero indexed
+ * Without one, D commands are sent until nn values are in
+ * CMD 16 stores the last continuous read the same way, under r[SENSOR ID] in sensor_storage
+ * CMD 18 stores a schedule under s[SENSOR ID] there too, see sched_pack()
+ *
+ * @param sensor
+ */
+void set_lookup(sensor_t& sensor)
+{
+    const char* key = ds_key(sensor);
+    char s_key[16];
+    uint64_t sched = sensor_key(s_key, 's', key) && sensor_storage.isKey(s_key) ? sensor_storage.getULong64(s_key, 0) : 0;
+    uint32_t period_s = (uint32_t)sched;
+    uint32_t phase_s = (sched >> 32) & 0xFFFFFF;
+    int8_t idx = sdi_index(sensor.addr);
+    sensor.period_s = period_s;
+    sensor.phase_s = phase_s;
+    sensor.priority = sched >> 56;
+    /** A rescan wipes the slot through parse_info(), so go by the due time rather than the old fields */
+    if(idx >= 0 && !sched_keep(sensor, sched_due[idx])) { sched_due[idx] = 0; }
+    sched_dirty = true;
+    if(sched != 0) { SDI_LOG(LVL_DEBUG, "FLASH", "Read: Schedule %s/%lu", s_key, (unsigned long)period_s); }
+
+    char r_key[16];
+    sensor.r_cmds = 0;
+    if(sensor_key(r_key, 'r', key) && sensor_storage.isKey(r_key))
+    {
+        uint32_t r_amt = sensor_storage.getUInt(r_key, 0);
+        /** R0-R9 only */
+        if(r_amt > 9) { r_amt = 9; }
+        sensor.r_cmds = r_amt + 1;
+        SDI_LOG(LVL_DEBUG, "FLASH", "Read: Continuous %s/%lu", r_key, (unsigned long)r_amt);
+    }
+
+    if(!flash_storage.isKey(key))
+    {
+        sensor.d_cmds = 0;
+        return;
+    }
+
+    uint32_t ds_amt = flash_storage.getUInt(key, 0);
+    /** D0-D9 only */
+    if(ds_amt > 9) { ds_amt = 9; }
+    sensor.d_cmds = ds_amt + 1;
+    SDI_LOG(LVL_DEBUG, "FLASH", "Read: Data set %s/%lu", key, (unsigned long)ds_amt);
+}
+
+/**
+ * @brief Flash key for a per-sensor setting in sensor_storage, kind then sensor ID
+ * NVS keys are 15 characters at most, a longer ID is logged and refused
+ *
+ * @param key 16 bytes
+ * @param kind r continuous reads, s schedule
+ * @param id serial number or address, see ds_key()
+ * @return true key fits
+ */
+bool sensor_key(char* key, char kind, const char* id)
+{
+    size_t len = strlen(id);
+    if(len == 0 || len > 14)
+    {
+        SDI_LOG(LVL_WARN, "FLASH", "Sensor ID must be 1 to 14 characters: %s", id);
+        return false;
+    }
+    key[0] = kind;
+    memcpy(key + 1, id, len + 1);
+    return true;
+}
+
+/**
+ * @brief Flash key for a sensor's data set
+ * Serial number from [a]I!, or the address if it has none
+ *
+ * @param sensor
+ * @return const char*
+ */
+const char* ds_key(const sensor_t& sensor)
+{
+    static char addr_key[2];
+    if(sensor.serial[0] != 0) { return sensor.serial; }
+
+    addr_key[0] = sensor.addr;
+    return addr_key;
+}
+
+/**
+ * @brief Parse [a]I! reply into sensor identity
+ * allccccccccmmmmmmvvvxxxxxxxxxxxxx
+ *
+ * @param reply
+ * @param sensor
+ */
+void parse_info(const char* reply, sensor_t& sensor)
+{
+    uint8_t values = sensor.values;
+    memset(&sensor, 0, sizeof(sensor));
+    sensor.addr = reply[0];
+    sensor.values = values;
+
+    /** Field widths from the SDI-12 spec, shorter replies leave fields empty */
+    struct { char* field; uint8_t len; } fields[] = {
+        { sensor.sdi_version, 2 },
+        { sensor.vendor, 8 },
+        { sensor.model, 6 },
+        { sensor.firmware, 3 },
+        { sensor.serial, 13 }
+    };
+
+    size_t pos = 1;
+    size_t len = strlen(reply);
+    for(auto& f : fields)
+    {
+        if(pos >= len) { break; }
+        strncpy(f.field, reply + pos, f.len);
+        pos += f.len;
+        /** Drop padding */
+        for(int y = strlen(f.field) - 1; y >= 0 && f.field[y] == ' '; y--)
+        {
+            f.field[y] = 0;
+        }
+    }
+}
+
+/**
+ * @brief Load saved sensor inventory from flash
+ * Fills the address cache without touching the bus
+ *
+ * @return true inventory found
+ * @return false nothing saved, or saved with an older layout
+ */
+bool inventory_load()
+{
+    static uint8_t blob[2 + SDI_MAX_ADDR*sizeof(sensor_t)];
+    size_t len = flash_storage.getBytesLength("inv");
+    if(len < 2 || len > sizeof(blob)) { return false; }
+
+    flash_storage.getBytes("inv", blob, len);
+    uint8_t count = blob[1];
+    if(blob[0] != INV_VERSION || len != 2 + count*sizeof(sensor_t) || count == 0) { return false; }
+
+    SDI_LOG(LVL_DEBUG, "FLASH", "Read: Inventory %u", count);
+    for(int x = 0; x < count; x++)
+    {
+        sensor_t sensor;
+        memcpy(&sensor, blob + 2 + x*sizeof(sensor_t), sizeof(sensor_t));
+        int8_t idx = sdi_index(sensor.addr);
+        if(idx < 0) { continue; }
+
+        sensors[idx] = sensor;
+        online_mask |= 1ULL << idx;
+        set_lookup(sensors[idx]);
+        num_sensors++;
+    }
+
+    return num_sensors > 0;
+}
+
+/**
+ * @brief Load the sensor table kept through deep sleep
+ * Skips flash and the validation scan, every INV_WAKE_CHECK wakes still check
+ *
+ * @return true woke with sensors kept
+ */
+bool inventory_wake()
+{
+    if(rtc_count == 0) { return false; }
+
+    memset(sensors, 0, sizeof(sensors));
+    online_mask = 0;
+    num_sensors = 0;
+    for(int x = 0; x < rtc_count; x++)
+    {
+        int8_t idx = sdi_index(rtc_sensors[x].addr);
+        if(idx < 0) { continue; }
+
+        /** d_cmds, r_cmds and the schedule came along, no flash lookups */
+        sensors[idx] = rtc_sensors[x];
+        online_mask |= 1ULL << idx;
+        num_sensors++;
+    }
+    rtc_count = 0;
+    sched_dirty = true;
+    return num_sensors > 0;
+}
+
+/**
+ * @brief Save sensor inventory to flash
+ * Skipped when nothing changed, to spare the flash
+ *
+ */
+void inventory_save()
+{
+    static uint8_t blob[2 + SDI_MAX_ADDR*sizeof(sensor_t)];
+    static uint8_t saved[sizeof(blob)];
+    uint8_t count = 0;
+    for(int x = 0; x < SDI_MAX_ADDR; x++)
+    {
+        if(sensors[x].addr == 0) { continue; }
+        memcpy(blob + 2 + count*sizeof(sensor_t), &sensors[x], sizeof(sensor_t));
+        count++;
+    }
+    blob[0] = INV_VERSION;
+    blob[1] = count;
+    size_t len = 2 + count*sizeof(sensor_t);
+    inv_dirty = false;
+
+    if(flash_storage.getBytesLength("inv") == len)
+    {
+        flash_storage.getBytes("inv", saved, len);
+        if(memcmp(blob, saved, len) == 0) { return; }
+    }
+
+    flash_storage.putBytes("inv", blob, len);
+    SDI_LOG(LVL_INFO, "FLASH", "Write: Inventory %u", count);
+}
+
+/**
+ * @brief SDI-12 address for a scan position
+ *
+ * @param idx 0 to SDI_MAX_ADDR
+ * @return char 0-9 a-z A-Z
+ */
+char sdi_addr(uint8_t idx)
+{
+    if(idx < 10) { return '0' + idx; }
+    if(idx < 36) { return 'a' + idx - 10; }
+    return 'A' + idx - 36;
+}
+
+/**
+ * @brief Scan position for an SDI-12 address
+ *
+ * @param addr 0-9 a-z A-Z
+ * @return int8_t 0 to SDI_MAX_ADDR, -1 if not an address
+ */
+int8_t sdi_index(char addr)
+{
+    if(addr >= '0' && addr <= '9') { return addr - '0'; }
+    if(addr >= 'a' && addr <= 'z') { return addr - 'a' + 10; }
+    if(addr >= 'A' && addr <= 'Z') { return addr - 'A' + 36; }
+    return -1;
+}
+
+/**
+ * @brief Queue a scan of all SDI-12 addresses
+ * Runs once the bus is idle
+ *
+ */
+void cache_online()
+{
+    scan_pending = (1ULL << SDI_MAX_ADDR) - 1;
+    scan_pending_full = true;
+}
+
+/**
+ * @brief Queue a scan of only some SDI-12 addresses
+ * The rest of the address cache is kept
+ *
+ * @param mask Bit per address, see sdi_index()
+ */
+void cache_rescan(uint64_t mask)
+{
+    scan_pending |= mask;
+}
+
+/**
+ * @brief Reload every sensor's data set from flash
+ * No bus traffic needed
+ *
+ */
+void cache_lookup()
+{
+    for(int x = 0; x < SDI_MAX_ADDR; x++)
+    {
+        if(sensors[x].addr != 0) { set_lookup(sensors[x]); }
+    }
+}
+
+/**
+ * @brief Queue SDI-12 sensor address change
+ * and cache online sensor addresses again
+ *
+ * @param addr_old
+ * @param addr_new
+ */
+void chng_addr(String addr_old, String addr_new)
+{
+    if(addr_old.length() == 0 || addr_new.length() == 0) { return; }
+    addr_pending[1] = addr_new[0];
+    addr_pending[0] = addr_old[0];
+}
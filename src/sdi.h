@@ -0,0 +1,95 @@
+/**
+ * @file sdi.h
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef __sdi_H__
+#define __sdi_H__
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <reading.h>
+
+/** Total SDI-12 addresses, 0-9 a-z A-Z */
+#define SDI_MAX_ADDR 62
+
+/**
+ * @brief Sensor descriptor, one slot per address
+ * Fixed size so the inventory can be saved to flash as is
+ *
+ */
+struct sensor_t
+{
+    /** SDI-12 address, 0 for no sensor */
+    char addr;
+    /** SDI-12 version, i.e 13 */
+    char sdi_version[3];
+    /** Vendor identification */
+    char vendor[9];
+    /** Sensor model */
+    char model[7];
+    /** Sensor version */
+    char firmware[4];
+    /** Optional serial number or other info */
+    char serial[14];
+    /** Values per measurement, nn from [a]M!/[a]C! */
+    uint8_t values;
+    /** D commands per measurement, D0 to D[d_cmds-1], 0 to stop once nn values are in */
+    uint8_t d_cmds;
+    /** Continuous reads R0 to R[r_cmds-1] instead of a measurement, 0 for none */
+    uint8_t r_cmds;
+    /** Higher goes on the bus first when sensors are due together */
+    uint8_t priority;
+    /** Own measurement period, seconds, 0 to follow the cycle */
+    uint32_t period_s;
+    /** Offset into the period, seconds past each multiple of period_s */
+    uint32_t phase_s;
+};
+
+/**
+ * @brief SDI-12 Lib
+ * Every bus transaction is a state machine stepped
+ * from loop(), nothing in here calls delay()
+ *
+ */
+class SDI
+{
+    public:
+    void sdi_setup();
+    void sdi_loop();
+    void sdi_measure(bool all);
+    bool sdi_idle();
+    uint64_t sdi_sched_us();
+    void sdi_sleep();
+};
+
+/** Overloads for engine */
+extern bool concurrent;
+extern bool use_crc;
+extern uint32_t fast_ms;
+extern bool single_sensor;
+extern uint32_t bus_tx_max;
+extern uint64_t bus_busy_us;
+extern uint32_t sdi_cycles;
+extern uint32_t sdi_readings;
+extern uint32_t cycle_ms;
+extern uint32_t cycle_start;
+extern uint64_t online_mask;
+extern Preferences flash_storage;
+extern Preferences sensor_storage;
+void cache_online();
+void cache_rescan(uint64_t mask);
+void cache_lookup();
+uint64_t sched_pack(uint32_t period_s, uint32_t phase_s, uint8_t priority);
+bool sensor_key(char* key, char kind, const char* id);
+void chng_addr(String addr_old, String addr_new);
+void sdi_reading(const reading_t& reading);
+void sdi_cycle_done();
+
+#endif
@@ -0,0 +1,84 @@
+/**
+ * @file spsc.h
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief Lock free single producer, single consumer ring
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef __spsc_H__
+#define __spsc_H__
+
+#include <Arduino.h>
+#include <atomic>
+
+/**
+ * @brief Fixed size ring of fixed size records
+ * One task pushes, one other task pops, no locks and no allocation
+ * Holds N - 1 records
+ *
+ */
+template<typename T, uint32_t N>
+class SPSC
+{
+    public:
+    /**
+     * @brief Add a record, producer side
+     *
+     * @param item
+     * @return true Added, false when full and counted in drops
+     */
+    bool push(const T& item)
+    {
+        uint32_t head = head_idx.load(std::memory_order_relaxed);
+        uint32_t next = (head + 1) % N;
+        if(next == tail_idx.load(std::memory_order_acquire))
+        {
+            drops++;
+            return false;
+        }
+        items[head] = item;
+        head_idx.store(next, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Take the oldest record, consumer side
+     *
+     * @param item
+     * @return true There was one
+     */
+    bool pop(T& item)
+    {
+        uint32_t tail = tail_idx.load(std::memory_order_relaxed);
+        if(tail == head_idx.load(std::memory_order_acquire)) { return false; }
+        item = items[tail];
+        tail_idx.store((tail + 1) % N, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Records waiting, either side
+     *
+     * @return uint32_t
+     */
+    uint32_t depth()
+    {
+        uint32_t head = head_idx.load(std::memory_order_acquire);
+        uint32_t tail = tail_idx.load(std::memory_order_acquire);
+        return (head + N - tail) % N;
+    }
+
+    /** Records refused because the ring was full */
+    uint32_t drops = 0;
+
+    private:
+    T items[N];
+    std::atomic<uint32_t> head_idx{0};
+    std::atomic<uint32_t> tail_idx{0};
+};
+
+#endif
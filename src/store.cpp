@@ -0,0 +1,493 @@
+/**
+ * @file store.cpp
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief Store and forward queue for readings that could not be published
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <Arduino.h>
+#include <store.h>
+#include <SD.h>
+#include <esp_attr.h>
+
+/** Segment file header, magic, version, record size */
+#define STORE_MAGIC 'Q'
+#define STORE_VERSION 2
+#define STORE_HEADER 4
+/** Save the read cursor after this many readings drained */
+#define STORE_SYNC_RECS 256
+
+/** RAM ring, newest readings */
+reading_t store_ram[STORE_RAM];
+/** Oldest reading in the ring */
+uint16_t ram_head;
+/** Readings in the ring */
+uint16_t ram_count;
+/** Oldest and newest segment, by sequence number */
+uint32_t seg_first;
+uint32_t seg_last;
+/** Readings in the oldest segment, while it is not the one being written */
+uint32_t seg_first_recs;
+/** Readings drained from the oldest segment */
+uint32_t seg_read;
+/** Readings written to the newest segment */
+uint32_t seg_written;
+/** Readings left in all segments */
+uint32_t file_count;
+/** Read cursor last saved to flash */
+uint32_t seg_saved;
+/** Segments changed since the cursor was saved */
+bool store_dirty = false;
+/** Readings queued */
+uint32_t store_queued;
+/** Queued readings published */
+uint32_t store_sent;
+/** Readings dropped to make room, or lost with the card */
+uint32_t store_dropped;
+/** Deepest the queue has been */
+uint32_t store_peak;
+
+/**
+ * @brief Queue state kept in RTC memory through deep sleep
+ *
+ */
+struct store_rtc_t
+{
+    /** Set going to sleep, cleared on wake */
+    bool valid;
+    uint32_t seg_first;
+    uint32_t seg_last;
+    uint32_t seg_first_recs;
+    uint32_t seg_read;
+    uint32_t seg_written;
+    uint32_t file_count;
+    uint32_t seg_saved;
+    uint32_t queued;
+    uint32_t sent;
+    uint32_t dropped;
+    uint32_t peak;
+    /** Newest readings, oldest first, only without a card */
+    uint16_t ram_count;
+    reading_t ram[STORE_RTC];
+};
+/** Queue state through deep sleep */
+RTC_DATA_ATTR store_rtc_t store_rtc;
+
+/** Forward declaration */
+void seg_path(uint32_t seq, char* out, size_t len);
+uint32_t seg_records(uint32_t seq);
+uint32_t first_records();
+void seg_append(const reading_t& reading);
+bool seg_peek(reading_t& reading);
+void seg_next();
+void ram_to_seg();
+bool store_wake();
+
+/**
+ * @brief Pick up segments left from before a restart
+ * Needs the SD card set up first
+ *
+ */
+void store_setup()
+{
+    ram_head = 0;
+    ram_count = 0;
+    if(store_wake()) { return; }
+    file_count = 0;
+    seg_first = flash_storage.getUInt("qfirst", 0);
+    seg_last = flash_storage.getUInt("qlast", 0);
+    seg_read = flash_storage.getUInt("qread", 0);
+    seg_saved = seg_read;
+    if(!card_found) { return; }
+
+    if(seg_last - seg_first >= STORE_SEGS)
+    {
+        seg_first = seg_last;
+        seg_read = 0;
+    }
+    for(uint32_t seq = seg_first; seq != seg_last + 1; seq++)
+    {
+        file_count += seg_records(seq);
+    }
+    file_count = file_count > seg_read ? file_count - seg_read : 0;
+    seg_first_recs = seg_records(seg_first);
+
+    if(file_count == 0)
+    {
+        char path[24];
+        for(uint32_t seq = seg_first; seq != seg_last + 1; seq++)
+        {
+            seg_path(seq, path, sizeof(path));
+            SD.remove(path);
+        }
+        seg_first = seg_last + 1;
+        seg_last = seg_first;
+        seg_read = 0;
+    } else if(seg_records(seg_last) > 0) {
+        /** Never append after a write that may have been cut short */
+        seg_last++;
+    }
+    seg_written = 0;
+    store_dirty = true;
+    store_sync();
+}
+
+/**
+ * @brief Queue a reading, never blocks
+ * When RAM is full the oldest reading there moves to SD, or is dropped without a card
+ *
+ * @param reading
+ */
+void store_push(const reading_t& reading)
+{
+    store_queued++;
+    if(ram_count == STORE_RAM)
+    {
+        if(card_found)
+        {
+            seg_append(store_ram[ram_head]);
+        } else {
+            store_dropped++;
+        }
+        ram_head = (ram_head + 1) % STORE_RAM;
+        ram_count--;
+    }
+    store_ram[(ram_head + ram_count) % STORE_RAM] = reading;
+    ram_count++;
+
+    uint32_t depth = store_depth();
+    if(depth > store_peak) { store_peak = depth; }
+}
+
+/**
+ * @brief Oldest queued reading
+ *
+ * @param reading
+ * @return true There is one
+ */
+bool store_peek(reading_t& reading)
+{
+    if(seg_peek(reading)) { return true; }
+    if(ram_count == 0) { return false; }
+    reading = store_ram[ram_head];
+    return true;
+}
+
+/**
+ * @brief Oldest queued readings, up to max
+ * Stops at the end of an SD segment, pop each one that was published
+ *
+ * @param out
+ * @param max
+ * @return uint8_t readings copied
+ */
+uint8_t store_peek_many(reading_t* out, uint8_t max)
+{
+    if(max == 0 || !store_peek(out[0])) { return 0; }
+
+    uint8_t count = 1;
+    if(file_count > 0)
+    {
+        uint32_t left = first_records() - seg_read - 1;
+        uint32_t want = left < (uint32_t)(max - 1) ? left : max - 1;
+        if(want == 0) { return count; }
+        char path[24];
+        seg_path(seg_first, path, sizeof(path));
+        File seg = SD.open(path, FILE_READ);
+        if(seg && seg.seek(STORE_HEADER + (seg_read + 1) * sizeof(reading_t)))
+        {
+            count += seg.read((uint8_t*)&out[1], want * sizeof(reading_t)) / sizeof(reading_t);
+        }
+        seg.close();
+    } else {
+        for(; count < max && count < ram_count; count++)
+        {
+            out[count] = store_ram[(ram_head + count) % STORE_RAM];
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Remove the oldest queued reading, after it was published
+ *
+ */
+void store_pop()
+{
+    if(file_count > 0)
+    {
+        file_count--;
+        seg_read++;
+        store_sent++;
+        if(seg_read >= first_records()) { seg_next(); }
+    } else if(ram_count > 0) {
+        ram_head = (ram_head + 1) % STORE_RAM;
+        ram_count--;
+        store_sent++;
+    }
+}
+
+/**
+ * @brief Move the RAM ring to SD, i.e before a restart
+ *
+ */
+void store_flush()
+{
+    if(!card_found) { return; }
+    ram_to_seg();
+    store_dirty = true;
+    store_sync();
+}
+
+/**
+ * @brief Keep the queue through deep sleep
+ * RAM moves to SD as on restart, the cursors go to RTC memory so a wake
+ * doesn't scan the segments or wait on flash. Without a card the newest
+ * STORE_RTC readings are kept and the rest count as dropped
+ *
+ */
+void store_sleep()
+{
+    if(card_found)
+    {
+        ram_to_seg();
+        store_sync();
+    }
+    while(ram_count > STORE_RTC)
+    {
+        ram_head = (ram_head + 1) % STORE_RAM;
+        ram_count--;
+        store_dropped++;
+    }
+    for(uint16_t x = 0; x < ram_count; x++)
+    {
+        store_rtc.ram[x] = store_ram[(ram_head + x) % STORE_RAM];
+    }
+    store_rtc.ram_count = ram_count;
+    store_rtc.seg_first = seg_first;
+    store_rtc.seg_last = seg_last;
+    store_rtc.seg_first_recs = seg_first_recs;
+    store_rtc.seg_read = seg_read;
+    store_rtc.seg_written = seg_written;
+    store_rtc.file_count = file_count;
+    store_rtc.seg_saved = seg_saved;
+    store_rtc.queued = store_queued;
+    store_rtc.sent = store_sent;
+    store_rtc.dropped = store_dropped;
+    store_rtc.peak = store_peak;
+    store_rtc.valid = true;
+}
+
+/**
+ * @brief Save segment numbers and read cursor to flash
+ * The cursor only every STORE_SYNC_RECS readings, a restart resends at most that many
+ *
+ */
+void store_sync()
+{
+    if(!card_found) { return; }
+    if(!store_dirty && seg_read - seg_saved < STORE_SYNC_RECS) { return; }
+    flash_storage.putUInt("qfirst", seg_first);
+    flash_storage.putUInt("qlast", seg_last);
+    flash_storage.putUInt("qread", seg_read);
+    seg_saved = seg_read;
+    store_dirty = false;
+}
+
+/**
+ * @brief Readings queued, RAM and SD
+ *
+ * @return uint32_t
+ */
+uint32_t store_depth()
+{
+    return file_count + ram_count;
+}
+
+/**
+ * @brief Pick the queue up from RTC memory after deep sleep
+ *
+ * @return true Woke with it kept
+ */
+bool store_wake()
+{
+    if(!store_rtc.valid) { return false; }
+    store_rtc.valid = false;
+    for(uint16_t x = 0; x < store_rtc.ram_count; x++) { store_ram[x] = store_rtc.ram[x]; }
+    ram_count = store_rtc.ram_count;
+    seg_first = store_rtc.seg_first;
+    seg_last = store_rtc.seg_last;
+    seg_first_recs = store_rtc.seg_first_recs;
+    seg_read = store_rtc.seg_read;
+    seg_written = store_rtc.seg_written;
+    file_count = store_rtc.file_count;
+    seg_saved = store_rtc.seg_saved;
+    store_queued = store_rtc.queued;
+    store_sent = store_rtc.sent;
+    store_dropped = store_rtc.dropped;
+    store_peak = store_rtc.peak;
+    store_dirty = false;
+    return true;
+}
+
+/**
+ * @brief Move the RAM ring to the newest segment
+ *
+ */
+void ram_to_seg()
+{
+    while(ram_count > 0)
+    {
+        seg_append(store_ram[ram_head]);
+        ram_head = (ram_head + 1) % STORE_RAM;
+        ram_count--;
+    }
+}
+
+/**
+ * @brief Segment file name
+ *
+ * @param seq
+ * @param out
+ * @param len
+ */
+void seg_path(uint32_t seq, char* out, size_t len)
+{
+    snprintf(out, len, "/sdi12q_%lu.bin", (unsigned long)seq);
+}
+
+/**
+ * @brief Whole readings in a segment file
+ *
+ * @param seq
+ * @return uint32_t 0 when missing or written by another layout
+ */
+uint32_t seg_records(uint32_t seq)
+{
+    char path[24];
+    seg_path(seq, path, sizeof(path));
+    File seg = SD.open(path, FILE_READ);
+    if(!seg) { return 0; }
+
+    uint8_t header[STORE_HEADER];
+    uint32_t records = 0;
+    if(seg.read(header, STORE_HEADER) == STORE_HEADER && header[0] == STORE_MAGIC &&
+        header[1] == STORE_VERSION && (header[2] | header[3] << 8) == sizeof(reading_t))
+    {
+        records = (seg.size() - STORE_HEADER) / sizeof(reading_t);
+    }
+    seg.close();
+    return records;
+}
+
+/**
+ * @brief Readings in the oldest segment
+ *
+ * @return uint32_t
+ */
+uint32_t first_records()
+{
+    return seg_first == seg_last ? seg_written : seg_first_recs;
+}
+
+/**
+ * @brief Append a reading to the newest segment
+ * A full segment starts the next, past STORE_SEGS the oldest is dropped
+ *
+ * @param reading
+ */
+void seg_append(const reading_t& reading)
+{
+    if(seg_written >= STORE_SEG_RECS)
+    {
+        if(seg_first == seg_last) { seg_first_recs = seg_written; }
+        seg_last++;
+        seg_written = 0;
+        store_dirty = true;
+        if(seg_last - seg_first >= STORE_SEGS) { seg_next(); }
+    }
+
+    char path[24];
+    seg_path(seg_last, path, sizeof(path));
+    if(seg_written == 0) { SD.remove(path); }
+    File seg = SD.open(path, FILE_APPEND);
+    if(!seg)
+    {
+        store_dropped++;
+        return;
+    }
+    if(seg_written == 0)
+    {
+        uint8_t header[STORE_HEADER] = { STORE_MAGIC, STORE_VERSION, sizeof(reading_t) & 0xFF, sizeof(reading_t) >> 8 };
+        seg.write(header, STORE_HEADER);
+    }
+    if(seg.write((const uint8_t*)&reading, sizeof(reading)) == sizeof(reading))
+    {
+        seg_written++;
+        file_count++;
+    } else {
+        store_dropped++;
+    }
+    seg.close();
+    store_sync();
+}
+
+/**
+ * @brief Oldest reading on SD
+ * Skips segments that went missing or can't be read
+ *
+ * @param reading
+ * @return true There is one
+ */
+bool seg_peek(reading_t& reading)
+{
+    while(file_count > 0)
+    {
+        if(seg_read < first_records())
+        {
+            char path[24];
+            seg_path(seg_first, path, sizeof(path));
+            File seg = SD.open(path, FILE_READ);
+            bool ok = seg && seg.seek(STORE_HEADER + seg_read * sizeof(reading_t)) &&
+                seg.read((uint8_t*)&reading, sizeof(reading)) == sizeof(reading);
+            seg.close();
+            if(ok) { return true; }
+        }
+        seg_next();
+    }
+    return false;
+}
+
+/**
+ * @brief Done with the oldest segment, delete it
+ * Readings not yet drained from it count as dropped
+ *
+ */
+void seg_next()
+{
+    uint32_t records = first_records();
+    uint32_t left = records > seg_read ? records - seg_read : 0;
+    if(left > file_count) { left = file_count; }
+    store_dropped += left;
+    file_count -= left;
+
+    char path[24];
+    seg_path(seg_first, path, sizeof(path));
+    SD.remove(path);
+    if(seg_first == seg_last)
+    {
+        /** Nothing left on SD, start over in a fresh segment */
+        file_count = 0;
+        seg_last++;
+        seg_written = 0;
+    }
+    seg_first++;
+    seg_read = 0;
+    seg_saved = 0;
+    seg_first_recs = seg_first == seg_last ? 0 : seg_records(seg_first);
+    store_dirty = true;
+}
@@ -0,0 +1,56 @@
+/**
+ * @file store.h
+ * @author Jamie Howse (r4wknet@gmail.com)
+ * @brief Store and forward queue for readings that could not be published
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef __store_H__
+#define __store_H__
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <reading.h>
+
+/** Readings held in RAM */
+#define STORE_RAM 64
+/** Readings per SD segment file */
+#define STORE_SEG_RECS 4096
+/** Segment files kept, the oldest is dropped whole to make room */
+#define STORE_SEGS 8
+/** Readings published per drain pass */
+#define STORE_BATCH 8
+/** Newest readings kept through deep sleep without a card */
+#define STORE_RTC 16
+
+/**
+ * @brief Queue readings in RAM, oldest spill to append only SD segments
+ * Oldest out first, the SD segments always hold older readings than RAM
+ * With no card the oldest RAM reading is dropped when full
+ *
+ */
+void store_setup();
+void store_push(const reading_t& reading);
+bool store_peek(reading_t& reading);
+uint8_t store_peek_many(reading_t* out, uint8_t max);
+void store_pop();
+void store_flush();
+void store_sync();
+void store_sleep();
+uint32_t store_depth();
+
+/** Queue counters */
+extern uint32_t store_queued;
+extern uint32_t store_sent;
+extern uint32_t store_dropped;
+extern uint32_t store_peak;
+
+/** Overloads for store */
+extern bool card_found;
+extern Preferences flash_storage;
+
+#endif